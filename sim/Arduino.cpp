@@ -0,0 +1,126 @@
+#include <Arduino.h>
+
+#include <chrono>
+#include <thread>
+#include <poll.h>
+#include <unistd.h>
+
+const String emptyString;
+HardwareSerial Serial;
+
+static bool realtimeClock = false;
+static uint64_t virtualMicros = 0;
+static const auto startTime = std::chrono::steady_clock::now();
+
+static uint64_t now() {
+    if (!realtimeClock) {
+        return virtualMicros;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+uint32_t millis() {
+    return now() / 1000;
+}
+
+uint32_t micros() {
+    return now();
+}
+
+void delay(uint32_t ms) {
+    delayMicroseconds(ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+    if (realtimeClock) {
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    } else {
+        virtualMicros += us;
+    }
+}
+
+void yield() {}
+
+namespace sim {
+
+void useRealtimeClock(bool realtime) {
+    virtualMicros = now();
+    realtimeClock = realtime;
+}
+
+void advanceClock(uint32_t us) {
+    virtualMicros += us;
+}
+
+} // namespace sim
+
+// stdin 输入缓冲, 模拟 UART 接收 FIFO
+static uint8_t rxBuffer[256];
+static size_t rxHead = 0, rxTail = 0;
+static bool rxClosed = false;
+
+static bool fillInput(int timeout) {
+    if (rxHead < rxTail) {
+        return true;
+    }
+    if (rxClosed) {
+        return false;
+    }
+    struct pollfd fd = { STDIN_FILENO, POLLIN, 0 };
+    if (poll(&fd, 1, timeout) <= 0) {
+        return false;
+    }
+    ssize_t n = ::read(STDIN_FILENO, rxBuffer, sizeof(rxBuffer));
+    if (n <= 0) {
+        rxClosed = true;
+        return false;
+    }
+    rxHead = 0;
+    rxTail = n;
+    return true;
+}
+
+namespace sim {
+
+bool waitSerial(int timeout) {
+    if (rxClosed && rxHead >= rxTail) { // 输入已结束, 只等待
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+        return false;
+    }
+    return fillInput(timeout);
+}
+
+bool serialClosed() {
+    return rxClosed && rxHead >= rxTail;
+}
+
+} // namespace sim
+
+int HardwareSerial::available() {
+    fillInput(0);
+    return rxTail - rxHead;
+}
+
+int HardwareSerial::read() {
+    if (!fillInput(0)) {
+        return -1;
+    }
+    return rxBuffer[rxHead++];
+}
+
+int HardwareSerial::peek() {
+    if (!fillInput(0)) {
+        return -1;
+    }
+    return rxBuffer[rxHead];
+}
+
+// 日志和命令回复写到 stderr, stdout 留给帧输出
+size_t HardwareSerial::write(uint8_t c) {
+    return fwrite(&c, 1, 1, stderr);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+    return fwrite(buffer, 1, size, stderr);
+}
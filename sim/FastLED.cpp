@@ -0,0 +1,182 @@
+#include <FastLED.h>
+
+#include <vector>
+
+CFastLED FastLED;
+
+static sim::ShowFunc showCallback;
+
+namespace sim {
+
+void setShowCallback(ShowFunc callback) {
+    showCallback = callback;
+}
+
+} // namespace sim
+
+// 以下算法移植自 FastLED, 保证模拟器与实机颜色一致
+void hsv2rgb_rainbow(const CHSV &hsv, CRGB &rgb) {
+    uint8_t hue = hsv.hue;
+    uint8_t sat = hsv.sat;
+    uint8_t val = hsv.val;
+
+    uint8_t offset = hue & 0x1F; // 0..31
+    uint8_t offset8 = offset << 3;
+    uint8_t third = scale8(offset8, (256 / 3)); // max = 85
+    uint8_t twothirds = scale8(offset8, ((256 * 2) / 3)); // max = 170
+
+    uint8_t r, g, b;
+    if (!(hue & 0x80)) {
+        if (!(hue & 0x40)) {
+            if (!(hue & 0x20)) { // 000 R -> O
+                r = 255 - third; g = third; b = 0;
+            } else { // 001 O -> Y
+                r = 171; g = 85 + third; b = 0;
+            }
+        } else {
+            if (!(hue & 0x20)) { // 010 Y -> G
+                r = 171 - twothirds; g = 170 + third; b = 0;
+            } else { // 011 G -> A
+                r = 0; g = 255 - third; b = third;
+            }
+        }
+    } else {
+        if (!(hue & 0x40)) {
+            if (!(hue & 0x20)) { // 100 A -> B
+                r = 0; g = 171 - twothirds; b = 85 + twothirds;
+            } else { // 101 B -> P
+                r = third; g = 0; b = 255 - third;
+            }
+        } else {
+            if (!(hue & 0x20)) { // 110 P -> K
+                r = 85 + third; g = 0; b = 171 - third;
+            } else { // 111 K -> R
+                r = 170 + third; g = 0; b = 85 - third;
+            }
+        }
+    }
+
+    if (sat != 255) {
+        if (sat == 0) {
+            r = 255; g = 255; b = 255;
+        } else {
+            uint8_t desat = 255 - sat;
+            desat = scale8_video(desat, desat);
+            uint8_t satscale = 255 - desat;
+            if (r) r = scale8(r, satscale);
+            if (g) g = scale8(g, satscale);
+            if (b) b = scale8(b, satscale);
+            r += desat; g += desat; b += desat;
+        }
+    }
+
+    if (val != 255) {
+        val = scale8_video(val, val);
+        if (val == 0) {
+            r = 0; g = 0; b = 0;
+        } else {
+            if (r) r = scale8(r, val);
+            if (g) g = scale8(g, val);
+            if (b) b = scale8(b, val);
+        }
+    }
+
+    rgb.r = r;
+    rgb.g = g;
+    rgb.b = b;
+}
+
+void fill_solid(CRGB *leds, int numToFill, const CRGB &color) {
+    for (int i = 0; i < numToFill; i++) {
+        leds[i] = color;
+    }
+}
+
+void fill_rainbow(CRGB *leds, int numToFill, uint8_t initialhue, uint8_t deltahue) {
+    CHSV hsv(initialhue, 240, 255);
+    for (int i = 0; i < numToFill; i++) {
+        hsv2rgb_rainbow(hsv, leds[i]);
+        hsv.hue += deltahue;
+    }
+}
+
+CRGB CRGB::computeAdjustment(uint8_t scale, const CRGB &colorCorrection, const CRGB &colorTemperature) {
+    CRGB adj(0, 0, 0);
+    if (scale > 0) {
+        for (uint8_t i = 0; i < 3; i++) {
+            uint8_t cc = colorCorrection.raw[i];
+            uint8_t ct = colorTemperature.raw[i];
+            if (cc > 0 && ct > 0) {
+                uint32_t work = (((uint32_t) cc) + 1) * (((uint32_t) ct) + 1) * scale;
+                work /= 0x10000L;
+                adj.raw[i] = work & 0xFF;
+            }
+        }
+    }
+    return adj;
+}
+
+// FastLED 默认的功耗模型: 5V, 每通道满亮度 16/11/15 mA, 静态 1 mA
+static const uint8_t gRed_mW   = 16 * 5;
+static const uint8_t gGreen_mW = 11 * 5;
+static const uint8_t gBlue_mW  = 15 * 5;
+static const uint8_t gDark_mW  =  1 * 5;
+
+uint32_t calculate_unscaled_power_mW(const CRGB *ledbuffer, uint16_t numLeds) {
+    uint32_t red32 = 0, green32 = 0, blue32 = 0;
+    for (uint16_t i = 0; i < numLeds; i++) {
+        red32   += ledbuffer[i].r;
+        green32 += ledbuffer[i].g;
+        blue32  += ledbuffer[i].b;
+    }
+    red32   *= gRed_mW;
+    green32 *= gGreen_mW;
+    blue32  *= gBlue_mW;
+    red32   >>= 8;
+    green32 >>= 8;
+    blue32  >>= 8;
+    return red32 + green32 + blue32 + gDark_mW * numLeds;
+}
+
+uint8_t calculate_max_brightness_for_power_mW(const CRGB *ledbuffer, uint16_t numLeds,
+    uint8_t target_brightness, uint32_t max_power_mW) {
+    uint32_t total_mW = calculate_unscaled_power_mW(ledbuffer, numLeds);
+    uint32_t requested_power_mW = ((uint32_t) total_mW * target_brightness) / 256;
+    uint8_t recommended_brightness = target_brightness;
+    if (requested_power_mW > max_power_mW) {
+        recommended_brightness = (uint32_t) target_brightness * max_power_mW / requested_power_mW;
+    }
+    return recommended_brightness;
+}
+
+CFastLED::CFastLED() :
+    controller{nullptr, 0}, brightness(255), correction(UncorrectedColor),
+    temperature(UncorrectedTemperature), maxPowerMW(0xFFFFFFFF) {}
+
+void CFastLED::show(uint8_t scale) {
+    if (!controller.leds) {
+        return;
+    }
+    if (maxPowerMW != 0xFFFFFFFF) {
+        scale = calculate_max_brightness_for_power_mW(controller.leds, controller.count, scale, maxPowerMW);
+    }
+    CRGB adj = CRGB::computeAdjustment(scale, correction, temperature);
+    static std::vector<CRGB> output;
+    output.resize(controller.count);
+    for (int i = 0; i < controller.count; i++) {
+        output[i] = controller.leds[i];
+        output[i].nscale8(adj);
+    }
+    if (showCallback) {
+        showCallback(output.data(), controller.count);
+    }
+}
+
+void CFastLED::clear(bool writeData) {
+    if (controller.leds) {
+        fill_solid(controller.leds, controller.count, CRGB::Black);
+    }
+    if (writeData) {
+        show(0);
+    }
+}
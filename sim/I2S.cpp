@@ -0,0 +1,94 @@
+#include <I2S.h>
+
+#include <Arduino.h>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+std::vector<int16_t> wavSamples; // 单声道
+uint32_t wavRate = 0;
+
+uint32_t readLE(const uint8_t *p, int bytes) {
+    uint32_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        value = value << 8 | p[i];
+    }
+    return value;
+}
+
+} // namespace
+
+bool sim::openWav(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buffer[4096];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.insert(data.end(), buffer, buffer + length);
+    }
+    fclose(file);
+    if (data.size() < 12 || memcmp(data.data(), "RIFF", 4) != 0 || memcmp(data.data() + 8, "WAVE", 4) != 0) {
+        fprintf(stderr, "%s: not a WAV file\n", path);
+        return false;
+    }
+    int channels = 0;
+    int bits = 0;
+    for (size_t offset = 12; offset + 8 <= data.size();) {
+        const uint8_t *chunk = data.data() + offset;
+        uint32_t size = std::min<uint32_t>(readLE(chunk + 4, 4), data.size() - offset - 8);
+        if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+            channels = readLE(chunk + 10, 2);
+            wavRate = readLE(chunk + 12, 4);
+            bits = readLE(chunk + 22, 2);
+            if (readLE(chunk + 8, 2) != 1 || bits != 16 || channels == 0) {
+                fprintf(stderr, "%s: only 16-bit PCM is supported\n", path);
+                return false;
+            }
+        } else if (memcmp(chunk, "data", 4) == 0 && channels > 0) {
+            for (uint32_t i = 0; i + channels * 2 <= size; i += channels * 2) {
+                int32_t sum = 0; // 多声道混为单声道
+                for (int c = 0; c < channels; c++) {
+                    sum += (int16_t) readLE(chunk + 8 + i + c * 2, 2);
+                }
+                wavSamples.push_back(sum / channels);
+            }
+        }
+        offset += 8 + size + (size & 1);
+    }
+    if (wavSamples.empty()) {
+        fprintf(stderr, "%s: no audio data\n", path);
+        return false;
+    }
+    return true;
+}
+
+bool I2S::begin(long sampleRate) {
+    this->sampleRate = sampleRate;
+    startTime = micros();
+    position = 0;
+    return true;
+}
+
+int I2S::available() {
+    if (sampleRate == 0) {
+        return 0;
+    }
+    uint64_t due = (uint64_t) (micros() - startTime) * sampleRate / 1000000;
+    return due > position ? std::min<uint64_t>(due - position, INT32_MAX) : 0;
+}
+
+bool I2S::read32(int32_t *left, int32_t *right) {
+    if (available() <= 0) {
+        return false;
+    }
+    uint64_t index = wavRate > 0 ? position * wavRate / sampleRate : 0;
+    int32_t sample = index < wavSamples.size() ? wavSamples[index] : 0;
+    *left = *right = sample << 16; // 与 32 位的 I2S 数据一样左对齐
+    position++;
+    return true;
+}
@@ -0,0 +1,57 @@
+#include <LittleFS.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+fs::FS LittleFS;
+
+namespace fs {
+
+const char *File::name() const {
+    const char *p = strrchr(path.c_str(), '/');
+    return p ? p + 1 : path.c_str();
+}
+
+size_t File::size() const {
+    struct stat st;
+    if (!fp || fstat(fileno(fp.get()), &st) != 0) {
+        return 0;
+    }
+    return st.st_size;
+}
+
+String FS::realPath(const char *path) const {
+    return root + (path[0] == '/' ? "" : "/") + path;
+}
+
+File FS::open(const char *path, const char *mode) {
+    String real = realPath(path);
+    struct stat st;
+    if (stat(real.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        return File(nullptr, path, true);
+    }
+    FILE *fp = fopen(real.c_str(), strchr(mode, 'b') ? mode : (String(mode) + "b").c_str());
+    if (!fp) {
+        return File();
+    }
+    return File(fp, path, false);
+}
+
+bool FS::exists(const char *path) const {
+    struct stat st;
+    return stat(realPath(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char *path) {
+    return ::remove(realPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char *from, const char *to) {
+    return ::rename(realPath(from).c_str(), realPath(to).c_str()) == 0;
+}
+
+bool FS::mkdir(const char *path) {
+    return ::mkdir(realPath(path).c_str(), 0755) == 0;
+}
+
+} // namespace fs
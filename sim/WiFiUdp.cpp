@@ -0,0 +1,62 @@
+#include <WiFiUdp.h>
+
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+uint8_t WiFiUDP::begin(uint16_t port) {
+    stop();
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return 0;
+    }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "Can't listen on UDP port %u\n", port);
+        stop();
+        return 0;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return 1;
+}
+
+void WiFiUDP::stop() {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    buffer.clear();
+    position = 0;
+}
+
+int WiFiUDP::parsePacket() {
+    if (fd < 0) {
+        return 0;
+    }
+    buffer.resize(65536);
+    ssize_t n = recv(fd, buffer.data(), buffer.size(), 0);
+    buffer.resize(n > 0 ? n : 0);
+    position = 0;
+    return buffer.size();
+}
+
+int WiFiUDP::read() {
+    return position < buffer.size() ? buffer[position++] : -1;
+}
+
+int WiFiUDP::read(uint8_t *data, size_t length) {
+    size_t n = std::min(length, buffer.size() - position);
+    memcpy(data, buffer.data() + position, n);
+    position += n;
+    return n;
+}
@@ -0,0 +1,92 @@
+// 主机模拟器用的 Arduino 核心替身, 仅实现了本项目用到的接口
+
+#ifndef __ARDUINO_H__
+#define __ARDUINO_H__
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t *) (addr))
+#define pgm_read_word(addr) (*(const uint16_t *) (addr))
+#define pgm_read_dword(addr) (*(const uint32_t *) (addr))
+#define memcpy_P memcpy
+#define strcmp_P strcmp
+#define snprintf_P snprintf
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+
+typedef uint8_t byte;
+
+template <typename T, typename L, typename H>
+inline T constrain(T x, L low, H high) {
+    return x < low ? low : (x > high ? high : x);
+}
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long baud) {}
+    void setTimeout(unsigned long timeout) {}
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+namespace sim {
+
+/**
+ * @brief Switch between wall clock and virtual clock
+ *
+ * The virtual clock only moves when advanceClock() is called, which makes
+ * offline renders deterministic no matter how fast the host is.
+ *
+ * @param realtime true to follow the host steady clock
+ */
+void useRealtimeClock(bool realtime);
+
+/**
+ * @brief Advance the virtual clock
+ *
+ * @param us microseconds to advance
+ */
+void advanceClock(uint32_t us);
+
+/**
+ * @brief Block until Serial has data to read
+ *
+ * @param timeout max time to wait in milliseconds, negative to wait forever
+ * @return true if data is available, false on timeout or end of input
+ */
+bool waitSerial(int timeout);
+
+/**
+ * @brief Check whether stdin behind Serial has been closed
+ */
+bool serialClosed();
+
+} // namespace sim
+
+#endif // __ARDUINO_H__
@@ -0,0 +1,257 @@
+// 主机模拟器用的 FastLED 替身, 颜色运算与 FastLED 保持一致, show() 时把输出交给模拟器
+
+#ifndef __FASTLED_H__
+#define __FASTLED_H__
+
+#include <cstdint>
+#include <functional>
+
+#include <Arduino.h>
+
+typedef uint8_t fract8;
+
+inline uint8_t scale8(uint8_t i, fract8 scale) {
+    return ((uint16_t) i * (1 + (uint16_t) scale)) >> 8;
+}
+
+inline uint8_t scale8_video(uint8_t i, fract8 scale) {
+    return (((uint16_t) i * (uint16_t) scale) >> 8) + ((i && scale) ? 1 : 0);
+}
+
+inline uint8_t qadd8(uint8_t i, uint8_t j) {
+    unsigned int t = i + j;
+    return t > 255 ? 255 : t;
+}
+
+inline uint8_t qsub8(uint8_t i, uint8_t j) {
+    return i > j ? i - j : 0;
+}
+
+inline uint8_t lerp8by8(uint8_t a, uint8_t b, fract8 frac) {
+    return b > a ? a + scale8(b - a, frac) : a - scale8(a - b, frac);
+}
+
+struct CHSV {
+    union {
+        struct {
+            union { uint8_t hue; uint8_t h; };
+            union { uint8_t saturation; uint8_t sat; uint8_t s; };
+            union { uint8_t value; uint8_t val; uint8_t v; };
+        };
+        uint8_t raw[3];
+    };
+
+    CHSV() {}
+    CHSV(uint8_t ih, uint8_t is, uint8_t iv) : h(ih), s(is), v(iv) {}
+};
+
+struct CRGB {
+    union {
+        struct {
+            union { uint8_t r; uint8_t red; };
+            union { uint8_t g; uint8_t green; };
+            union { uint8_t b; uint8_t blue; };
+        };
+        uint8_t raw[3];
+    };
+
+    enum HTMLColorCode {
+        Black  = 0x000000,
+        Blue   = 0x0000FF,
+        Cyan   = 0x00FFFF,
+        Green  = 0x008000,
+        Lime   = 0x00FF00,
+        Magenta = 0xFF00FF,
+        Orange = 0xFFA500,
+        Purple = 0x800080,
+        Red    = 0xFF0000,
+        White  = 0xFFFFFF,
+        Yellow = 0xFFFF00,
+    };
+
+    CRGB() {}
+    CRGB(uint8_t ir, uint8_t ig, uint8_t ib) : r(ir), g(ig), b(ib) {}
+    CRGB(uint32_t colorcode) : r((colorcode >> 16) & 0xFF), g((colorcode >> 8) & 0xFF), b(colorcode & 0xFF) {}
+    CRGB(HTMLColorCode colorcode) : CRGB((uint32_t) colorcode) {}
+    CRGB(const CHSV &rhs);
+
+    uint8_t &operator[](uint8_t x) { return raw[x]; }
+    const uint8_t &operator[](uint8_t x) const { return raw[x]; }
+
+    CRGB &operator=(uint32_t colorcode) {
+        r = (colorcode >> 16) & 0xFF;
+        g = (colorcode >> 8) & 0xFF;
+        b = colorcode & 0xFF;
+        return *this;
+    }
+    CRGB &operator=(const CHSV &rhs);
+
+    CRGB &setRGB(uint8_t nr, uint8_t ng, uint8_t nb) {
+        r = nr; g = ng; b = nb;
+        return *this;
+    }
+
+    CRGB &operator+=(const CRGB &rhs) {
+        r = qadd8(r, rhs.r); g = qadd8(g, rhs.g); b = qadd8(b, rhs.b);
+        return *this;
+    }
+
+    CRGB &operator-=(const CRGB &rhs) {
+        r = qsub8(r, rhs.r); g = qsub8(g, rhs.g); b = qsub8(b, rhs.b);
+        return *this;
+    }
+
+    CRGB &nscale8(uint8_t scaledown) {
+        r = scale8(r, scaledown); g = scale8(g, scaledown); b = scale8(b, scaledown);
+        return *this;
+    }
+
+    CRGB &nscale8(const CRGB &scaledown) {
+        r = scale8(r, scaledown.r); g = scale8(g, scaledown.g); b = scale8(b, scaledown.b);
+        return *this;
+    }
+
+    CRGB &nscale8_video(uint8_t scaledown) {
+        r = scale8_video(r, scaledown); g = scale8_video(g, scaledown); b = scale8_video(b, scaledown);
+        return *this;
+    }
+
+    CRGB &fadeToBlackBy(uint8_t fadefactor) {
+        return nscale8(255 - fadefactor);
+    }
+
+    uint8_t getLuma() const {
+        return scale8(r, 54) + scale8(g, 183) + scale8(b, 18);
+    }
+
+    explicit operator bool() const {
+        return r || g || b;
+    }
+
+    bool operator==(const CRGB &rhs) const {
+        return r == rhs.r && g == rhs.g && b == rhs.b;
+    }
+
+    bool operator!=(const CRGB &rhs) const {
+        return !(*this == rhs);
+    }
+
+    static CRGB computeAdjustment(uint8_t scale, const CRGB &colorCorrection, const CRGB &colorTemperature);
+};
+
+void hsv2rgb_rainbow(const CHSV &hsv, CRGB &rgb);
+void fill_solid(CRGB *leds, int numToFill, const CRGB &color);
+void fill_rainbow(CRGB *leds, int numToFill, uint8_t initialhue, uint8_t deltahue = 5);
+
+inline CRGB::CRGB(const CHSV &rhs) {
+    hsv2rgb_rainbow(rhs, *this);
+}
+
+inline CRGB &CRGB::operator=(const CHSV &rhs) {
+    hsv2rgb_rainbow(rhs, *this);
+    return *this;
+}
+
+enum EOrder {
+    RGB = 0012,
+    RBG = 0021,
+    GRB = 0102,
+    GBR = 0120,
+    BRG = 0201,
+    BGR = 0210,
+};
+
+enum LEDColorCorrection {
+    TypicalSMD5050 = 0xFFB0F0,
+    TypicalLEDStrip = 0xFFB0F0,
+    UncorrectedColor = 0xFFFFFF,
+};
+
+enum ColorTemperature {
+    Candle = 0xFF9329,
+    Tungsten40W = 0xFFC58F,
+    Tungsten100W = 0xFFD6AA,
+    Halogen = 0xFFF1E0,
+    DirectSunlight = 0xFFFFFF,
+    UncorrectedTemperature = 0xFFFFFF,
+};
+
+// 模拟器不区分芯片型号, 这些类型只为让 addLeds<LED_TYPE, ...> 能编译
+#define SIM_DECLARE_CHIPSET(name) \
+    template <uint8_t DATA_PIN, EOrder RGB_ORDER> class name {};
+SIM_DECLARE_CHIPSET(WS2811)
+SIM_DECLARE_CHIPSET(WS2812)
+SIM_DECLARE_CHIPSET(WS2812B)
+SIM_DECLARE_CHIPSET(WS2813)
+SIM_DECLARE_CHIPSET(WS2815)
+SIM_DECLARE_CHIPSET(SK6812)
+SIM_DECLARE_CHIPSET(NEOPIXEL)
+SIM_DECLARE_CHIPSET(APA106)
+#undef SIM_DECLARE_CHIPSET
+
+class CLEDController {
+public:
+    CRGB *leds;
+    int count;
+
+    void setLeds(CRGB *data, int nLeds) {
+        leds = data;
+        count = nLeds;
+    }
+};
+
+class CFastLED {
+private:
+    CLEDController controller;
+    uint8_t brightness;
+    CRGB correction;
+    CRGB temperature;
+    uint32_t maxPowerMW;
+
+public:
+    CFastLED();
+
+    template <template <uint8_t DATA_PIN, EOrder RGB_ORDER> class CHIPSET, uint8_t DATA_PIN, EOrder RGB_ORDER>
+    CLEDController &addLeds(CRGB *data, int nLedsOrOffset, int nLedsIfOffset = 0) {
+        controller.leds = nLedsIfOffset > 0 ? data + nLedsOrOffset : data;
+        controller.count = nLedsIfOffset > 0 ? nLedsIfOffset : nLedsOrOffset;
+        return controller;
+    }
+
+    void setBrightness(uint8_t scale) { brightness = scale; }
+    uint8_t getBrightness() { return brightness; }
+    void setCorrection(const CRGB &correction) { this->correction = correction; }
+    void setTemperature(const CRGB &temperature) { this->temperature = temperature; }
+    void setMaxPowerInMilliWatts(uint32_t milliwatts) { maxPowerMW = milliwatts; }
+
+    CRGB *leds() { return controller.leds; }
+    int size() { return controller.count; }
+
+    void show() { show(brightness); }
+    void show(uint8_t scale);
+    void clear(bool writeData = false);
+};
+
+extern CFastLED FastLED;
+
+uint32_t calculate_unscaled_power_mW(const CRGB *ledbuffer, uint16_t numLeds);
+uint8_t calculate_max_brightness_for_power_mW(const CRGB *ledbuffer, uint16_t numLeds,
+    uint8_t target_brightness, uint32_t max_power_mW);
+
+namespace sim {
+
+typedef std::function<void(const CRGB *leds, int count)> ShowFunc;
+
+/**
+ * @brief Receive every frame that FastLED.show() would shift out
+ *
+ * The frame passed to the callback already has brightness, color
+ * correction, temperature and power limit applied, in wiring order.
+ *
+ * @param callback frame sink
+ */
+void setShowCallback(ShowFunc callback);
+
+} // namespace sim
+
+#endif // __FASTLED_H__
@@ -0,0 +1,41 @@
+// 主机模拟器用的 I2S 输入替身, 接口与 RP2040 的 I2S 库相同, 按时钟从 WAV 文件中取出样本, 只支持输入
+
+#ifndef __I2S_H__
+#define __I2S_H__
+
+#include <cstdint>
+#include <vector>
+
+class I2S {
+private:
+    uint32_t sampleRate;
+    uint32_t startTime;
+    uint64_t position; // 已读的样本数
+
+public:
+    I2S(int direction) : sampleRate(0), startTime(0), position(0) {}
+
+    bool setBCLK(int pin) { return true; }
+    bool setDATA(int pin) { return true; }
+    bool setBitsPerSample(int bits) { return true; }
+    bool begin(long sampleRate);
+    int available();
+    bool read32(int32_t *left, int32_t *right);
+};
+
+namespace sim {
+
+/**
+ * @brief Load a 16-bit PCM WAV file as the microphone input
+ *
+ * The file is resampled to the rate passed to I2S::begin() and played once
+ * following the simulator clock, silence follows the end of the file.
+ *
+ * @param path WAV file path
+ * @return true if the file is loaded
+ */
+bool openWav(const char *path);
+
+} // namespace sim
+
+#endif // __I2S_H__
@@ -0,0 +1,103 @@
+// 主机模拟器用的 LittleFS 替身, 把设备路径映射到主机上的一个目录 (默认为 data)
+
+#ifndef __LITTLEFS_H__
+#define __LITTLEFS_H__
+
+#include <cstdio>
+#include <memory>
+
+#include <Arduino.h>
+
+namespace fs {
+
+enum SeekMode {
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2,
+};
+
+class File : public Stream {
+private:
+    std::shared_ptr<FILE> fp;
+    String path;
+    bool directory;
+
+public:
+    File() : directory(false) {}
+    File(FILE *fp, const String &path, bool directory) :
+        fp(fp, [](FILE *f) { if (f) fclose(f); }), path(path), directory(directory) {}
+
+    explicit operator bool() const { return fp || directory; }
+    bool isFile() const { return (bool) fp; }
+    bool isDirectory() const { return directory; }
+    const char *name() const;
+    const char *fullName() const { return path.c_str(); }
+
+    size_t size() const;
+    size_t position() const { return fp ? ftell(fp.get()) : 0; }
+    bool seek(uint32_t pos, SeekMode mode = SeekSet) {
+        return fp && fseek(fp.get(), pos, mode == SeekSet ? SEEK_SET : (mode == SeekCur ? SEEK_CUR : SEEK_END)) == 0;
+    }
+
+    int available() override { return fp ? size() - position() : 0; }
+    int read() override { return fp ? fgetc(fp.get()) : -1; }
+    int peek() override {
+        if (!fp) return -1;
+        int c = fgetc(fp.get());
+        if (c >= 0) ungetc(c, fp.get());
+        return c;
+    }
+    size_t read(uint8_t *buffer, size_t length) { return fp ? fread(buffer, 1, length, fp.get()) : 0; }
+    size_t write(uint8_t c) override { return fp ? fwrite(&c, 1, 1, fp.get()) : 0; }
+    size_t write(const uint8_t *buffer, size_t size) override { return fp ? fwrite(buffer, 1, size, fp.get()) : 0; }
+    using Print::write;
+    void flush() override { if (fp) fflush(fp.get()); }
+
+    void close() {
+        fp.reset();
+        directory = false;
+    }
+};
+
+class FS {
+private:
+    String root;
+
+    String realPath(const char *path) const;
+
+public:
+    FS() : root("data") {}
+
+    /**
+     * @brief Set the host directory that backs the filesystem
+     *
+     * @param dir host directory
+     */
+    void setRoot(const char *dir) { root = dir; }
+
+    bool begin() { return true; }
+    bool begin(bool formatOnFail) { return true; }
+    void end() {}
+
+    File open(const char *path, const char *mode = "r");
+    File open(const String &path, const char *mode = "r") { return open(path.c_str(), mode); }
+    bool exists(const char *path) const;
+    bool exists(const String &path) const { return exists(path.c_str()); }
+    bool remove(const char *path);
+    bool remove(const String &path) { return remove(path.c_str()); }
+    bool rename(const char *from, const char *to);
+    bool mkdir(const char *path);
+};
+
+} // namespace fs
+
+using fs::File;
+using fs::FS;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+
+extern fs::FS LittleFS;
+
+#endif // __LITTLEFS_H__
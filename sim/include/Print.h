@@ -0,0 +1,60 @@
+// 主机模拟器用的 Arduino Print 替身
+
+#ifndef __PRINT_H__
+#define __PRINT_H__
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include "WString.h"
+
+class Print {
+public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) {
+        size_t n = 0;
+        while (size--) {
+            n += write(*buffer++);
+        }
+        return n;
+    }
+    virtual void flush() {}
+
+    size_t write(const char *str) {
+        return write((const uint8_t *) str, strlen(str));
+    }
+
+    size_t print(const char *str) { return write(str); }
+    size_t print(const String &str) { return write(str.c_str()); }
+    size_t print(const __FlashStringHelper *str) { return write(reinterpret_cast<const char *>(str)); }
+    size_t print(char c) { return write((uint8_t) c); }
+    size_t print(int value) { return printf("%d", value); }
+    size_t print(unsigned int value) { return printf("%u", value); }
+    size_t print(long value) { return printf("%ld", value); }
+    size_t print(unsigned long value) { return printf("%lu", value); }
+    size_t print(double value, int digits = 2) { return printf("%.*f", digits, value); }
+
+    size_t println() { return write("\r\n"); }
+    template <typename T>
+    size_t println(const T &value) { return print(value) + println(); }
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+        char str[256];
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(str, sizeof(str), format, args);
+        va_end(args);
+        if (len < 0) return 0;
+        return write((const uint8_t *) str, (size_t) len < sizeof(str) ? len : sizeof(str) - 1);
+    }
+    template <typename... Args>
+    size_t printf_P(const char *format, Args... args) {
+        return printf(format, args...);
+    }
+};
+
+#endif // __PRINT_H__
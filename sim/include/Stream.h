@@ -0,0 +1,37 @@
+// 主机模拟器用的 Arduino Stream 替身
+
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include "Print.h"
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    size_t readBytes(char *buffer, size_t length) {
+        size_t n = 0;
+        while (n < length) {
+            int c = read();
+            if (c < 0) break;
+            buffer[n++] = (char) c;
+        }
+        return n;
+    }
+    size_t readBytes(uint8_t *buffer, size_t length) {
+        return readBytes((char *) buffer, length);
+    }
+    size_t readBytesUntil(char terminator, char *buffer, size_t length) {
+        size_t n = 0;
+        while (n < length) {
+            int c = read();
+            if (c < 0 || c == terminator) break;
+            buffer[n++] = (char) c;
+        }
+        return n;
+    }
+};
+
+#endif // __STREAM_H__
@@ -0,0 +1,105 @@
+// 主机模拟器用的 Arduino String 替身, 仅实现了本项目用到的接口
+
+#ifndef __WSTRING_H__
+#define __WSTRING_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+
+class __FlashStringHelper;
+#define FPSTR(pstr_pointer) (reinterpret_cast<const __FlashStringHelper *>(pstr_pointer))
+#define F(string_literal) (FPSTR(string_literal))
+
+class String {
+private:
+    std::string buffer;
+
+public:
+    String() {}
+    String(const char *str) : buffer(str ? str : "") {}
+    String(const std::string &str) : buffer(str) {}
+    String(const __FlashStringHelper *str) : buffer(reinterpret_cast<const char *>(str)) {}
+    explicit String(char c) : buffer(1, c) {}
+    explicit String(int value, unsigned char base = 10) : buffer(format(value, base)) {}
+    explicit String(unsigned int value, unsigned char base = 10) : buffer(format(value, base)) {}
+    explicit String(long value, unsigned char base = 10) : buffer(format(value, base)) {}
+    explicit String(unsigned long value, unsigned char base = 10) : buffer(format(value, base)) {}
+    explicit String(float value, unsigned char decimals = 2) : String((double) value, decimals) {}
+    explicit String(double value, unsigned char decimals = 2) {
+        char str[64];
+        snprintf(str, sizeof(str), "%.*f", decimals, value);
+        buffer = str;
+    }
+
+    const char *c_str() const { return buffer.c_str(); }
+    unsigned int length() const { return buffer.length(); }
+    char *begin() { return &buffer[0]; }
+    char *end() { return &buffer[0] + buffer.length(); }
+    char charAt(unsigned int index) const { return index < buffer.length() ? buffer[index] : '\0'; }
+    char operator[](unsigned int index) const { return charAt(index); }
+    bool isEmpty() const { return buffer.empty(); }
+    void reserve(unsigned int size) { buffer.reserve(size); }
+
+    bool concat(const char *str) { buffer += str; return true; }
+    bool concat(const char *str, unsigned int length) { buffer.append(str, length); return true; }
+    bool concat(const String &str) { buffer += str.buffer; return true; }
+    bool concat(char c) { buffer += c; return true; }
+    String &operator+=(const String &str) { concat(str); return *this; }
+    String &operator+=(const char *str) { concat(str); return *this; }
+    String &operator+=(char c) { concat(c); return *this; }
+    friend String operator+(const String &lhs, const String &rhs) { return String(lhs.buffer + rhs.buffer); }
+    friend String operator+(const String &lhs, const char *rhs) { return String(lhs.buffer + rhs); }
+
+    bool operator==(const String &rhs) const { return buffer == rhs.buffer; }
+    bool operator==(const char *rhs) const { return buffer == rhs; }
+    bool operator!=(const String &rhs) const { return buffer != rhs.buffer; }
+    bool operator!=(const char *rhs) const { return buffer != rhs; }
+    bool startsWith(const String &prefix) const { return buffer.compare(0, prefix.buffer.length(), prefix.buffer) == 0; }
+    bool endsWith(const String &suffix) const {
+        return buffer.length() >= suffix.buffer.length() &&
+            buffer.compare(buffer.length() - suffix.buffer.length(), suffix.buffer.length(), suffix.buffer) == 0;
+    }
+    int indexOf(char c, unsigned int from = 0) const {
+        size_t pos = buffer.find(c, from);
+        return pos == std::string::npos ? -1 : (int) pos;
+    }
+    String substring(unsigned int from, unsigned int to = (unsigned int) -1) const {
+        if (from >= buffer.length()) return String();
+        return String(buffer.substr(from, to - from));
+    }
+    long toInt() const { return strtol(buffer.c_str(), NULL, 10); }
+    float toFloat() const { return strtof(buffer.c_str(), NULL); }
+
+    void trim() {
+        size_t begin = buffer.find_first_not_of(" \t\r\n");
+        if (begin == std::string::npos) {
+            buffer.clear();
+            return;
+        }
+        size_t end = buffer.find_last_not_of(" \t\r\n");
+        buffer = buffer.substr(begin, end - begin + 1);
+    }
+
+private:
+    template <typename T>
+    static std::string format(T value, unsigned char base) {
+        if (base == 10) return std::to_string(value);
+        char str[8 * sizeof(T) + 1];
+        char *p = str + sizeof(str) - 1;
+        *p = '\0';
+        unsigned long long v = (unsigned long long) value;
+        do {
+            int digit = v % base;
+            *--p = digit < 10 ? '0' + digit : 'a' + digit - 10;
+            v /= base;
+        } while (v);
+        return p;
+    }
+};
+
+extern const String emptyString;
+
+#endif // __WSTRING_H__
@@ -0,0 +1,29 @@
+// 主机模拟器用的 WiFiUDP 替身, 基于非阻塞的 POSIX UDP 套接字, 只支持接收
+
+#ifndef __WIFIUDP_H__
+#define __WIFIUDP_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class WiFiUDP {
+private:
+    int fd;
+    std::vector<uint8_t> buffer; // 当前数据包
+    size_t position;
+
+public:
+    WiFiUDP() : fd(-1), position(0) {}
+    ~WiFiUDP() { stop(); }
+
+    uint8_t begin(uint16_t port);
+    void stop();
+    int parsePacket();
+    int available() { return buffer.size() - position; }
+    int read();
+    int read(uint8_t *data, size_t length);
+    int read(char *data, size_t length) { return read((uint8_t *) data, length); }
+};
+
+#endif // __WIFIUDP_H__
@@ -0,0 +1,432 @@
+/**
+ * RGB Light 主机模拟器
+ *
+ * 在 Linux 上编译运行灯效引擎, 从 stdin 读取命令, 把每一帧输出为文本转储, PPM 图片序列或 ANSI 终端画面
+ *
+ * 用法: program [--frames N] [--realtime] [--output dump|ppm|ansi|none] [--out PATH] [--scale N] [--fs DIR] [--wav FILE]
+ *
+ * 除设备上的命令外, 模拟器还支持 wait,N (运行 N 帧的时长后再读取下一条命令), bin,HEX (模拟 WebSocket 二进制消息) 和 quit,
+ * 灯效静止时和设备上一样不会刷新, 所以帧数均按时长计算. --wav 指定的 16 位 PCM 文件按时钟代替麦克风输入
+ */
+
+#include "config.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <FastLED.h>
+
+#include "LightControl.hpp"
+#include "utils.h"
+
+enum OutputFormat {
+    OUTPUT_NONE,
+    OUTPUT_DUMP, // 每帧一行, 按接线顺序输出 RRGGBB
+    OUTPUT_PPM,  // 每帧一张 PPM 图片
+    OUTPUT_ANSI, // 真彩色终端画面
+};
+
+// 模拟器中灯珠在二维画面上的排布, index 为 -1 的格子不对应任何灯珠
+struct View {
+    int width;
+    int height;
+    std::vector<int> index;
+
+    void resize(int w, int h) {
+        width = w;
+        height = h;
+        index.assign(w * h, -1);
+    }
+
+    void set(int x, int y, const CRGB &led, const CRGB *base) {
+        index[y * width + x] = &led - base;
+    }
+};
+
+struct Options {
+    long frames = -1;
+    bool realtime = false;
+    const char *wav = nullptr;
+    OutputFormat output = OUTPUT_ANSI;
+    const char *out = nullptr;
+    int scale = 8;
+} options;
+
+struct Stats {
+    uint32_t frames;
+    uint32_t shownFrames;
+    uint64_t updateTime;
+    uint64_t showTime;
+    uint32_t maxFrameTime;
+} stats;
+
+CRGB outputLeds[LIGHT_TYPE::led_count];
+View view;
+FILE *output;
+bool waiting = false;
+uint32_t waitUntil;
+bool quit = false;
+
+LightConfig config = {60, 63, 6600};
+
+template <int COUNT, bool REVERSE>
+void layout(LightStrip<COUNT, REVERSE> &light, View &view) {
+    view.resize(light.l(), 1);
+    for (int i = 0; i < light.l(); i++) {
+        view.set(i, 0, light.at(i), light.data());
+    }
+}
+
+template <int X_COUNT, int Y_COUNT, int ARRANGEMENT>
+void layout(LightPanel<X_COUNT, Y_COUNT, ARRANGEMENT> &light, View &view) {
+    view.resize(light.w(), light.h());
+    for (int y = 0; y < light.h(); y++) {
+        for (int x = 0; x < light.w(); x++) {
+            view.set(x, light.h() - y - 1, light.at(x, y), light.data()); // y 轴朝上
+        }
+    }
+}
+
+template <int ARRANGEMENT, int... COUNT_PER_RING>
+void layout(LightDisc<ARRANGEMENT, COUNT_PER_RING...> &light, View &view) {
+    int width = 0;
+    for (int i = 0; i < light.r(); i++) {
+        width = std::max(width, light.l(i));
+    }
+    view.resize(width, light.r());
+    for (int i = 0; i < light.r(); i++) {
+        for (int j = 0; j < light.l(i); j++) {
+            view.set(j, i, light.at(i, j), light.data());
+        }
+    }
+}
+
+// 光立方按层从下到上依次横向排开, 层与层之间空一列
+template <int X_COUNT, int Y_COUNT, int Z_COUNT>
+void layout(LightCube<X_COUNT, Y_COUNT, Z_COUNT> &light, View &view) {
+    view.resize((light.l() + 1) * light.h() - 1, light.w());
+    for (int z = 0; z < light.h(); z++) {
+        for (int y = 0; y < light.w(); y++) {
+            for (int x = 0; x < light.l(); x++) {
+                view.set(z * (light.l() + 1) + x, light.w() - y - 1, light.at(x, y, z), light.data());
+            }
+        }
+    }
+}
+
+void writeDump(const CRGB *leds, int count) {
+    fprintf(output, "%u %u", stats.frames, millis());
+    for (int i = 0; i < count; i++) {
+        fprintf(output, " %02x%02x%02x", leds[i].r, leds[i].g, leds[i].b);
+    }
+    fputc('\n', output);
+}
+
+void writePPM(const CRGB *leds, int count) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s%06u.ppm", options.out ? options.out : "frame_", stats.frames);
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        Serial.printf("Can't write %s\n", path);
+        return;
+    }
+    int scale = options.scale;
+    fprintf(file, "P6\n%d %d\n255\n", view.width * scale, view.height * scale);
+    for (int y = 0; y < view.height * scale; y++) {
+        for (int x = 0; x < view.width * scale; x++) {
+            int index = view.index[(y / scale) * view.width + x / scale];
+            CRGB pixel = index >= 0 ? leds[index] : CRGB(0x202020);
+            fwrite(pixel.raw, 1, 3, file);
+        }
+    }
+    fclose(file);
+}
+
+void writeANSI(const CRGB *leds, int count) {
+    fputs("\x1b[H", output);
+    for (int y = 0; y < view.height; y++) {
+        for (int x = 0; x < view.width; x++) {
+            int index = view.index[y * view.width + x];
+            if (index >= 0) {
+                const CRGB &pixel = leds[index];
+                fprintf(output, "\x1b[48;2;%u;%u;%um  ", pixel.r, pixel.g, pixel.b);
+            } else {
+                fputs("\x1b[0m  ", output);
+            }
+        }
+        fputs("\x1b[0m\n", output);
+    }
+    fprintf(output, "frame %u, %u ms\x1b[K\n", stats.frames, millis());
+    fflush(output);
+}
+
+void showFrame(const CRGB *leds, int count) {
+    stats.shownFrames++;
+    switch (options.output) {
+        case OUTPUT_DUMP: writeDump(leds, count); break;
+        case OUTPUT_PPM: writePPM(leds, count); break;
+        case OUTPUT_ANSI: writeANSI(leds, count); break;
+        default: break;
+    }
+}
+
+// 模拟器的设置不保存
+void settingsChanged(uint8_t change) {}
+
+// 渲染在主循环中进行, 下一次调用的时间由 updateLight 的返回值决定
+void signalLight() {}
+
+void showLight() {
+    auto t0 = std::chrono::steady_clock::now();
+    if (colorPipeline.apply(light.data(), outputLeds, light.count())) {
+        forceShow = true; // 功率限制正在恢复, 继续刷新
+    }
+#ifdef ENABLE_LATENCY_TRACE
+    latency.endRender();
+#endif
+    FastLED.show();
+#ifdef ENABLE_LATENCY_TRACE
+    latency.shown();
+#endif
+    auto t1 = std::chrono::steady_clock::now();
+    stats.showTime += std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+}
+
+// 调用 updateLight 并统计每帧的耗时, 返回值与 updateLight 相同
+uint32_t renderLight() {
+    uint32_t frames = frameClock.getRenderedFrames();
+    uint64_t showTime = stats.showTime;
+    auto t0 = std::chrono::steady_clock::now();
+    uint32_t wait = updateLight();
+    auto t1 = std::chrono::steady_clock::now();
+    if (frameClock.getRenderedFrames() != frames) {
+        uint32_t frameTime = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+        stats.updateTime += frameTime - (stats.showTime - showTime);
+        stats.maxFrameTime = std::max(stats.maxFrameTime, frameTime);
+        stats.frames++;
+    }
+    return wait;
+}
+
+// 把时钟拨到 time, 实时模式下则等待
+void sleepUntil(uint32_t time) {
+    int32_t remain = time - micros();
+    if (remain <= 0) {
+        return;
+    }
+    if (options.realtime) {
+        std::this_thread::sleep_for(std::chrono::microseconds(remain));
+    } else {
+        sim::advanceClock(remain);
+    }
+}
+
+void registerCommands() {
+    registerLightCommands(config);
+    cmdHandler.registerCommand("quit", "Exit simulator", [](SenderFunc sender, int argc, char *argv[]) {
+        quit = true;
+    });
+    cmdHandler.registerCommand("wait", "Run N frame periods before next command", [](SenderFunc sender, int argc, char *argv[]) {
+        long frames = argc > 1 ? atol(argv[1]) : 1;
+        waitUntil = micros() + (uint64_t) frames * 1000000 / frameRate.load(std::memory_order_relaxed);
+        waiting = frames > 0;
+    });
+    cmdHandler.registerCommand("status", "Show status", [](SenderFunc sender, int argc, char *argv[]) {
+        StaticJsonDocument<512> doc;
+        writeLightStatus(doc);
+        String str;
+        serializeJson(doc, str);
+        sender(str.c_str());
+    });
+    // 模拟 WebSocket 的二进制消息, 参数为十六进制数据
+    cmdHandler.registerCommand("bin", "Send binary frame in hex", [](SenderFunc sender, int argc, char *argv[]) {
+        std::vector<uint8_t> data;
+        for (const char *p = argc > 1 ? argv[1] : ""; isxdigit(p[0]) && isxdigit(p[1]); p += 2) {
+            char byte[3] = {p[0], p[1], '\0'};
+            data.push_back(strtol(byte, NULL, 16));
+        }
+        handleBinary(sender, data.data(), data.size());
+    });
+}
+
+/**
+ * @brief Handle data from Serial until a command line is ready, Adalight/TPM2 frames go to realtime input
+ *
+ * @param timeout max time to wait in milliseconds, negative to wait forever
+ * @return char* the command line, nullptr if there is none
+ */
+char* readLine(int timeout) {
+    while (true) {
+        char *line = pollSerial();
+        if (line) {
+            return line;
+        }
+        if (Serial.available() > 0) {
+            continue;
+        }
+        if (timeout == 0 || !sim::waitSerial(timeout)) {
+            // 最后一行可能没有换行符
+            return sim::serialClosed() && serialReceiver.flushLine() ? serialReceiver.getLine() : nullptr;
+        }
+    }
+}
+
+bool parseOptions(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (strcmp(arg, "--realtime") == 0) {
+            options.realtime = true;
+            continue;
+        }
+        if (!value) {
+            return false;
+        }
+        i++;
+        if (strcmp(arg, "--frames") == 0) {
+            options.frames = atol(value);
+        } else if (strcmp(arg, "--out") == 0) {
+            options.out = value;
+        } else if (strcmp(arg, "--scale") == 0) {
+            options.scale = std::max(1, atoi(value));
+        } else if (strcmp(arg, "--wav") == 0) {
+            options.wav = value;
+        } else if (strcmp(arg, "--fs") == 0) {
+            LittleFS.setRoot(value);
+        } else if (strcmp(arg, "--output") == 0) {
+            if (strcmp(value, "dump") == 0) {
+                options.output = OUTPUT_DUMP;
+            } else if (strcmp(value, "ppm") == 0) {
+                options.output = OUTPUT_PPM;
+            } else if (strcmp(value, "ansi") == 0) {
+                options.output = OUTPUT_ANSI;
+            } else if (strcmp(value, "none") == 0) {
+                options.output = OUTPUT_NONE;
+            } else {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (!parseOptions(argc, argv)) {
+        fprintf(stderr, "Usage: %s [--frames N] [--realtime] [--output dump|ppm|ansi|none] "
+            "[--out PATH] [--scale N] [--fs DIR] [--wav FILE]\n", argv[0]);
+        return 1;
+    }
+    output = stdout;
+    if (options.output == OUTPUT_DUMP && options.out && strcmp(options.out, "-") != 0) {
+        output = fopen(options.out, "w");
+        if (!output) {
+            perror(options.out);
+            return 1;
+        }
+    }
+    sim::useRealtimeClock(options.realtime);
+
+    FastLED.addLeds<LED_TYPE, LED_DATA_PIN, LED_COLOR_ORDER>(outputLeds, light.count());
+#ifdef LED_CORRECTION
+    colorPipeline.setCorrection(CRGB(LED_CORRECTION));
+#endif
+    FastLED.clear();
+    colorPipeline.checkPowerLimit(light.count());
+    colorPipeline.setBrightness(config.brightness);
+    colorPipeline.setTemperature(config.temperature);
+    sim::setShowCallback(showFrame);
+    layout(light, view);
+    if (options.output == OUTPUT_ANSI) {
+        fputs("\x1b[2J", output);
+    } else if (options.output == OUTPUT_DUMP) {
+        fprintf(output, "# frame millis leds[%d]\n", light.count());
+    }
+
+    lightEffect.publish(new (lightEffect.allocate()) ConstantEffect<LIGHT_TYPE>(DEFAULT_COLOR));
+    registerCommands();
+    startFrameClock(config.refreshRate);
+#ifdef ENABLE_REALTIME
+    if (options.realtime) { // UDP 数据按真实时间到达, 离线渲染时不接收
+        realtime.begin();
+    }
+#endif
+#ifdef ENABLE_MICROPHONE
+    if (options.wav) {
+        if (!sim::openWav(options.wav)) {
+            return 1;
+        }
+        microphone.begin();
+    }
+#endif
+
+    SenderFunc sender = [](const char *msg) {
+        Serial.println(msg);
+    };
+    uint32_t endTime = micros() + (uint64_t) std::max(options.frames, 0L) * 1000000 / frameRate.load(std::memory_order_relaxed);
+    while (!quit) {
+        char *line;
+        while (!waiting && !quit && (line = readLine(options.realtime ? 0 : -1))) {
+            handleCommand(sender, line);
+        }
+        if (quit || (options.frames >= 0 && (int32_t) (micros() - endTime) >= 0)) {
+            break;
+        }
+        // 离线渲染时输入结束即退出, 除非指定了帧数
+        if (!options.realtime && !waiting && options.frames < 0 && sim::serialClosed()) {
+            break;
+        }
+#ifdef ENABLE_REALTIME
+        handleRealtime();
+#endif
+#ifdef ENABLE_MICROPHONE
+        if (options.wav) {
+            handleMicrophone();
+        }
+#endif
+        handleAnimation();
+        uint32_t wait = renderLight();
+#ifdef ENABLE_LATENCY_TRACE
+        latency.poll([](int8_t client, const char *msg) {
+            Serial.println(msg);
+        });
+#endif
+        // 离线渲染时直接把虚拟时钟拨到下一次需要刷新的时间, 但不越过 wait 和 --frames 的结束时间
+        uint32_t now = micros();
+        uint32_t next = wait == NO_UPDATE ? UINT32_MAX : frameClock.untilNextFrame(now);
+#ifdef ENABLE_MICROPHONE
+        if (options.wav && lightEffect->type() == MUSIC) { // 灯效静止时也要按时读取麦克风
+            next = std::min<uint32_t>(next, 1000000 / frameRate.load(std::memory_order_relaxed));
+        }
+#endif
+        if (waiting) {
+            next = std::min<uint32_t>(next, std::max<int32_t>(waitUntil - now, 0));
+        }
+        if (options.frames >= 0) {
+            next = std::min<uint32_t>(next, std::max<int32_t>(endTime - now, 0));
+        }
+        if (next == UINT32_MAX) { // 静止且没有等待, 继续读取命令
+            if (options.realtime) {
+                sim::waitSerial(10);
+            }
+            continue;
+        }
+        sleepUntil(now + next);
+        if (waiting && (int32_t) (micros() - waitUntil) >= 0) {
+            waiting = false;
+        }
+    }
+
+    if (stats.frames > 0) {
+        fprintf(stderr, "%u frames (%u shown, %u skipped), avg update %.1f us, avg show %.1f us, max frame %u us\n",
+            stats.frames, stats.shownFrames, frameClock.getSkippedFrames(), (double) stats.updateTime / stats.frames,
+            (double) stats.showTime / stats.frames, stats.maxFrameTime);
+    }
+    if (output != stdout) {
+        fclose(output);
+    }
+    return 0;
+}
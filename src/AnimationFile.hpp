@@ -0,0 +1,558 @@
+#ifndef __ANIMATIONFILE_HPP__
+#define __ANIMATIONFILE_HPP__
+
+#include "config.h"
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <FastLED.h>
+
+// 没有文件头的旧格式动画的帧率, 即编辑器以前烘焙动画时的帧率
+#define ANIMATION_FPS 30
+// 解码压缩动画时的读取缓冲大小(字节)
+#ifndef ANIMATION_READ_SIZE
+#define ANIMATION_READ_SIZE 64
+#endif
+// 关键帧动画读入内存的最大字节数, 即静态缓冲的大小, 映射到内存中的不受限制. ESP8266 内存较少, 默认更小
+#ifndef ANIMATION_KEYFRAME_SIZE
+#if defined(ESP8266)
+#define ANIMATION_KEYFRAME_SIZE 4096
+#else
+#define ANIMATION_KEYFRAME_SIZE 16384
+#endif
+#endif
+
+/**
+ * 逐帧动画文件
+ *
+ * v2 格式以 20 字节的文件头开始, 数字均为小端:
+ *   0  "RGBL"
+ *   4  u8  版本, 为 2
+ *   5  u8  颜色格式, 见 Format
+ *   6  u16 灯珠数
+ *   8  u16 帧率
+ *   10 u16 调色板颜色数, 0 为不使用调色板, 仅压缩格式
+ *   12 u32 帧数
+ *   16 u32 帧偏移表的位置
+ * 调色板紧跟文件头, 每个颜色 3 字节 RGB.
+ * 帧偏移表共 帧数 + 1 项 u32, 依次为每一帧在文件中的起始位置, 最后一项为数据的结尾, 最高位为 1 表示关键帧.
+ * 顺序播放时不需要读取偏移表, 只有往回跳或循环时才读.
+ * 没有文件头的旧格式按当前灯珠数和 ANIMATION_FPS 播放.
+ *
+ * FORMAT_RGB 每帧为连续的 RGB 数据, 用一次读取直接读入灯珠数据.
+ * FORMAT_RLE 每帧以帧类型开始, 0 为关键帧, 1 为在上一帧基础上修改的增量帧, 之后是依次覆盖所有灯珠的片段,
+ * 每个片段以一个字节开始, 高 2 位为类型, 低 6 位为灯珠数减 1:
+ *   0 后面跟着每颗灯珠的颜色
+ *   1 后面跟着一个颜色, 重复这么多颗灯珠
+ *   2 这些灯珠保持上一帧的颜色
+ * 颜色为 3 字节 RGB, 有调色板时为 1 字节下标. 解码时经过固定大小的缓冲直接写入灯珠数据, 不需要额外的帧缓冲.
+ *
+ * FORMAT_KEYFRAME 保存编辑器中的关键帧, 播放时逐帧求值, 文件大小只与关键帧数有关, 帧率可以任意设置.
+ * 文件头中帧数的位置为时长 (ms), 帧偏移表的位置为轨道表的位置, 帧数按时长和帧率计算.
+ * 文件头之后是所有关键帧, 每个 16 字节: u32 时间 (ms), RGB, u8 标志 (1 为保持到下一个关键帧),
+ * 4 个 i16 为左右控制点 (左 x, 左 y, 右 x, 右 y), 1.0 为 4096, 与编辑器相同按三次贝塞尔曲线过渡.
+ * 轨道表共 灯珠数 + 1 项 u32, 第 i 颗灯珠的关键帧为第 [表[i], 表[i + 1]) 个, 按时间排列, 没有关键帧的灯珠熄灭.
+ * 关键帧和轨道表整个读入内存, 最多 ANIMATION_KEYFRAME_SIZE 字节, 映射到内存时直接使用原数据.
+ *
+ * 灯珠数与动画不同时只播放重叠的部分, 其余灯珠熄灭.
+ * 除了 LittleFS 中的文件, 也可以直接播放映射到内存中的数据, 此时按指针读取, 不经过缓冲.
+ * 从文件读取的调色板和关键帧放在所有实例共用的静态缓冲中, 同一时间只能打开一个从文件读取的动画
+ */
+class AnimationFile {
+public:
+    enum Format : uint8_t {
+        FORMAT_RGB = 0,
+        FORMAT_RLE = 1,
+        FORMAT_KEYFRAME = 2,
+    };
+
+    static constexpr uint8_t FORMAT_VERSION = 2;
+    static constexpr size_t HEADER_SIZE = 20;
+
+private:
+    enum FrameType : uint8_t {
+        KEY_FRAME = 0,
+        DELTA_FRAME = 1,
+    };
+
+    enum Segment : uint8_t {
+        SEGMENT_LITERAL = 0,
+        SEGMENT_RUN = 1,
+        SEGMENT_SKIP = 2,
+    };
+
+    static constexpr uint32_t KEY_FLAG = 0x80000000;
+    static constexpr size_t KEYFRAME_SIZE = 16;
+    static constexpr uint8_t KEYFRAME_HOLD = 0x01;
+    static constexpr int32_t ONE = 4096; // 关键帧插值使用的定点数, 12 位小数
+
+    File file;
+    const uint8_t *data;  // 映射到内存中的动画, 为空时读取 file
+    uint32_t dataSize;
+    uint32_t position;
+    uint8_t version;      // 1 为没有文件头的旧格式
+    uint8_t format;
+    uint16_t ledCount;
+    uint16_t frameRate;
+    uint16_t paletteSize;
+    uint32_t frameCount;
+    uint32_t indexOffset;
+    uint32_t nextFrame;   // 文件当前位置对应的帧
+    const CRGB *palette;  // 映射到内存时直接使用原数据
+    const uint8_t *keyframes;
+    uint32_t keyframeCount;
+    uint16_t bufferPos;
+    uint16_t bufferLength;
+    uint8_t buffer[ANIMATION_READ_SIZE];
+
+    // 从文件读取的调色板, 颜色数最多 256
+    static CRGB* paletteBuffer() {
+        static CRGB buffer[256];
+        return buffer;
+    }
+
+    // 从文件读取的关键帧和轨道表
+    static uint8_t* keyframeBuffer() {
+        static uint8_t buffer[ANIMATION_KEYFRAME_SIZE];
+        return buffer;
+    }
+
+    static uint16_t readU16(const uint8_t *p) {
+        return p[0] | p[1] << 8;
+    }
+
+    static uint32_t readU32(const uint8_t *p) {
+        return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+    }
+
+    uint32_t size() {
+        return data ? dataSize : file.size();
+    }
+
+    bool seek(uint32_t pos) {
+        bufferPos = bufferLength = 0;
+        if (!data) {
+            return file.seek(pos);
+        }
+        if (pos > dataSize) {
+            return false;
+        }
+        position = pos;
+        return true;
+    }
+
+    size_t read(uint8_t *dest, size_t length) {
+        if (!data) {
+            return file.read(dest, length);
+        }
+        length = std::min<size_t>(length, dataSize - position);
+        memcpy(dest, data + position, length);
+        position += length;
+        return length;
+    }
+
+    bool readHeader() {
+        uint8_t header[HEADER_SIZE];
+        if (size() < HEADER_SIZE || read(header, HEADER_SIZE) != HEADER_SIZE || memcmp(header, "RGBL", 4) != 0) {
+            return false;
+        }
+        version = header[4];
+        format = header[5];
+        ledCount = readU16(header + 6);
+        frameRate = readU16(header + 8);
+        paletteSize = readU16(header + 10);
+        frameCount = readU32(header + 12);
+        indexOffset = readU32(header + 16);
+        if (version != FORMAT_VERSION || format > FORMAT_KEYFRAME || ledCount == 0 || frameRate == 0) {
+            Serial.printf_P(PSTR("Unsupported animation, version: %u, format: %u\n"), version, format);
+            return false;
+        }
+        if (format == FORMAT_KEYFRAME) {
+            return paletteSize == 0 && readKeyframes();
+        }
+        uint32_t end;
+        bool key;
+        if ((uint64_t) indexOffset + (frameCount + 1) * 4ULL > size() || !readIndex(frameCount, end, key) || end > size()) {
+            Serial.println(F("Broken animation index"));
+            return false;
+        }
+        return paletteSize == 0 || readPalette();
+    }
+
+    bool readPalette() {
+        size_t size = paletteSize * sizeof(CRGB);
+        if (format != FORMAT_RLE || paletteSize > 256 || HEADER_SIZE + size > indexOffset) {
+            Serial.println(F("Broken animation palette"));
+            return false;
+        }
+        if (data) {
+            palette = (const CRGB *) (data + HEADER_SIZE);
+            return true;
+        }
+        palette = paletteBuffer();
+        return seek(HEADER_SIZE) && read((uint8_t *) paletteBuffer(), size) == size;
+    }
+
+    bool readKeyframes() {
+        uint32_t duration = frameCount;
+        if (indexOffset < HEADER_SIZE || (indexOffset - HEADER_SIZE) % KEYFRAME_SIZE != 0 ||
+            (uint64_t) indexOffset + (ledCount + 1) * 4 > size() || duration == 0) {
+            Serial.println(F("Broken animation keyframes"));
+            return false;
+        }
+        uint32_t length = indexOffset + (ledCount + 1) * 4 - HEADER_SIZE;
+        if (data) {
+            keyframes = data + HEADER_SIZE;
+        } else {
+            if (length > ANIMATION_KEYFRAME_SIZE) {
+                Serial.println(F("Too many animation keyframes"));
+                return false;
+            }
+            keyframes = keyframeBuffer();
+            if (!seek(HEADER_SIZE) || read(keyframeBuffer(), length) != length) {
+                return false;
+            }
+        }
+        keyframeCount = (indexOffset - HEADER_SIZE) / KEYFRAME_SIZE;
+        const uint8_t *tracks = keyframes + keyframeCount * KEYFRAME_SIZE;
+        for (int i = 0; i < ledCount; i++) {
+            uint32_t first = readU32(tracks + i * 4), last = readU32(tracks + i * 4 + 4);
+            if (first > last || last > keyframeCount) {
+                Serial.println(F("Broken animation keyframes"));
+                return false;
+            }
+        }
+        frameCount = std::max<uint32_t>(((uint64_t) duration * frameRate + 999) / 1000, 1);
+        return true;
+    }
+
+    // 三次贝塞尔曲线 3(1-s)^2 s p1 + 3(1-s) s^2 p2 + s^3, 两端为 0 和 1
+    static int32_t bezier(int32_t s, int32_t p1, int32_t p2) {
+        int32_t r = ONE - s;
+        int32_t a = r * r / ONE * s / ONE;
+        int32_t b = r * s / ONE * s / ONE;
+        return (3 * a * p1 + 3 * b * p2) / ONE + s * s / ONE * s / ONE;
+    }
+
+    // 与 CSS 的 cubic-bezier 相同, 先二分求出 x 对应的参数, 再求 y
+    static int32_t ease(int32_t x, int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+        x1 = constrain(x1, 0, (int32_t) ONE);
+        x2 = constrain(x2, 0, (int32_t) ONE);
+        int32_t lo = 0, hi = ONE;
+        while (hi - lo > 1) {
+            int32_t mid = (lo + hi) / 2;
+            if (bezier(mid, x1, x2) < x) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        return bezier(x <= 0 ? 0 : hi, y1, y2);
+    }
+
+    static uint8_t lerp(uint8_t from, uint8_t to, int32_t y) {
+        return constrain(from + (to - from) * y / ONE, 0, 255);
+    }
+
+    CRGB evaluateTrack(uint32_t first, uint32_t end, uint32_t time) {
+        const uint8_t *k0 = keyframes + first * KEYFRAME_SIZE;
+        if (time < readU32(k0)) { // 第一个关键帧之前保持第一个关键帧的颜色
+            return CRGB(k0[4], k0[5], k0[6]);
+        }
+        uint32_t last = end;
+        while (last - first > 1) { // 找到最后一个不晚于 time 的关键帧
+            uint32_t mid = (first + last) / 2;
+            if (readU32(keyframes + mid * KEYFRAME_SIZE) <= time) {
+                first = mid;
+            } else {
+                last = mid;
+            }
+        }
+        k0 = keyframes + first * KEYFRAME_SIZE;
+        const uint8_t *k1 = k0 + KEYFRAME_SIZE;
+        if (first + 1 >= end || (k0[7] & KEYFRAME_HOLD)) {
+            return CRGB(k0[4], k0[5], k0[6]);
+        }
+        uint32_t t0 = readU32(k0), t1 = readU32(k1);
+        int32_t x = (uint64_t) (time - t0) * ONE / (t1 - t0);
+        int32_t y = ease(x, (int16_t) readU16(k0 + 12), (int16_t) readU16(k0 + 14),
+            (int16_t) readU16(k1 + 8), (int16_t) readU16(k1 + 10));
+        return CRGB(lerp(k0[4], k1[4], y), lerp(k0[5], k1[5], y), lerp(k0[6], k1[6], y));
+    }
+
+    void evaluate(uint32_t frame, CRGB *leds, int count) {
+        uint32_t time = (uint64_t) frame * 1000 / frameRate;
+        const uint8_t *tracks = keyframes + keyframeCount * KEYFRAME_SIZE;
+        for (int i = 0, n = std::min<int>(count, ledCount); i < n; i++) {
+            uint32_t first = readU32(tracks + i * 4), last = readU32(tracks + i * 4 + 4);
+            leds[i] = first < last ? evaluateTrack(first, last, time) : CRGB::Black;
+        }
+    }
+
+    bool readIndex(uint32_t frame, uint32_t &offset, bool &key) {
+        uint8_t entry[4];
+        if (!seek(indexOffset + frame * 4) || read(entry, 4) != 4) {
+            return false;
+        }
+        offset = readU32(entry) & ~KEY_FLAG;
+        key = format == FORMAT_RGB || (entry[3] & 0x80);
+        return true;
+    }
+
+    // 定位到 frame 及之前最近的关键帧, key 为该帧
+    bool seekKeyFrame(uint32_t frame, uint32_t &key) {
+        if (version == 1) {
+            key = frame;
+            return seek(frame * ledCount * sizeof(CRGB));
+        }
+        for (key = frame; ; key--) {
+            uint32_t offset;
+            bool isKey;
+            if (!readIndex(key, offset, isKey)) {
+                return false;
+            }
+            if (isKey || key == 0) {
+                return seek(offset);
+            }
+        }
+    }
+
+    int readByte() {
+        if (data) {
+            return position < dataSize ? data[position++] : -1;
+        }
+        if (bufferPos == bufferLength) {
+            int read = file.read(buffer, sizeof(buffer));
+            if (read <= 0) {
+                return -1;
+            }
+            bufferPos = 0;
+            bufferLength = read;
+        }
+        return buffer[bufferPos++];
+    }
+
+    bool readColor(CRGB &color) {
+        if (paletteSize > 0) {
+            int index = readByte();
+            if (index < 0 || index >= paletteSize) {
+                return false;
+            }
+            color = palette[index];
+            return true;
+        }
+        for (int i = 0; i < 3; i++) {
+            int c = readByte();
+            if (c < 0) {
+                return false;
+            }
+            color.raw[i] = c;
+        }
+        return true;
+    }
+
+    bool readRGBFrame(CRGB *leds, int count) {
+        int n = std::min<int>(count, ledCount);
+        size_t size = n * sizeof(CRGB);
+        if (read((uint8_t *) leds, size) != size) {
+            return false;
+        }
+        if (n < ledCount) { // 跳过多出来的灯珠
+            if (data) {
+                position = std::min<uint32_t>(position + (ledCount - n) * sizeof(CRGB), dataSize);
+            } else {
+                file.seek((ledCount - n) * sizeof(CRGB), SeekCur);
+            }
+        }
+        return true;
+    }
+
+    // 逐个片段解码, 超出 count 的灯珠只读取不写入
+    bool readRLEFrame(CRGB *leds, int count) {
+        int type = readByte();
+        if (type != KEY_FRAME && type != DELTA_FRAME) {
+            return false;
+        }
+        for (int i = 0; i < ledCount;) {
+            int segment = readByte();
+            if (segment < 0) {
+                return false;
+            }
+            int length = (segment & 0x3F) + 1;
+            if (i + length > ledCount) {
+                return false;
+            }
+            CRGB color;
+            switch (segment >> 6) {
+            case SEGMENT_LITERAL:
+                for (int end = i + length; i < end; i++) {
+                    if (!readColor(color)) {
+                        return false;
+                    }
+                    if (i < count) {
+                        leds[i] = color;
+                    }
+                }
+                break;
+            case SEGMENT_RUN:
+                if (!readColor(color)) {
+                    return false;
+                }
+                if (i < count) {
+                    fill_solid(leds + i, std::min(length, count - i), color);
+                }
+                i += length;
+                break;
+            case SEGMENT_SKIP:
+                i += length;
+                break;
+            default:
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool begin(int count) {
+        if (!readHeader()) {
+            if (size() >= HEADER_SIZE && version != 0) { // 有文件头但无法播放
+                close();
+                return false;
+            }
+            version = 1;
+            format = FORMAT_RGB;
+            ledCount = count;
+            frameRate = ANIMATION_FPS;
+            frameCount = size() / (count * sizeof(CRGB));
+        } else if (ledCount != count) {
+            Serial.printf_P(PSTR("Animation has %u leds but the light has %d\n"), ledCount, count);
+        }
+        nextFrame = UINT32_MAX; // 第一次读取时定位
+        if (frameCount == 0) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+public:
+    AnimationFile() :
+        data(nullptr), dataSize(0), position(0), version(0), format(FORMAT_RGB), ledCount(0), frameRate(0), paletteSize(0), frameCount(0),
+        indexOffset(0), nextFrame(0), palette(nullptr),
+        keyframes(nullptr), keyframeCount(0), bufferPos(0), bufferLength(0) {}
+
+    AnimationFile(const AnimationFile&) = delete;
+    AnimationFile& operator=(const AnimationFile&) = delete;
+
+    ~AnimationFile() {
+        close();
+    }
+
+    /**
+     * @brief Open an animation and read its header
+     *
+     * @param path file path
+     * @param count led count of the light, used by headerless files
+     * @return true if the file can be played
+     */
+    bool open(const char *path, int count) {
+        close();
+        file = LittleFS.open(path, "r");
+#if defined(ESP32)
+        if (!file || file.isDirectory()) {
+#else
+        if (!file.isFile()) {
+#endif
+            close();
+            return false;
+        }
+        return begin(count);
+    }
+
+    /**
+     * @brief Open an animation mapped into memory, which must stay valid until close
+     *
+     * @param data start of the animation
+     * @param length size of the animation in bytes
+     * @param count led count of the light, used by headerless data
+     * @return true if the data can be played
+     */
+    bool open(const uint8_t *data, uint32_t length, int count) {
+        close();
+        this->data = data;
+        dataSize = length;
+        position = 0;
+        return begin(count);
+    }
+
+    void close() {
+        if (file) {
+            file.close();
+        }
+        data = nullptr;
+        palette = nullptr;
+        keyframes = nullptr;
+        paletteSize = 0;
+        version = 0;
+        frameCount = 0;
+    }
+
+    explicit operator bool() const {
+        return frameCount > 0;
+    }
+
+    // 是否映射在内存中, 读取不会阻塞
+    bool isMapped() const {
+        return data != nullptr;
+    }
+
+    uint16_t getFrameRate() const {
+        return frameRate;
+    }
+
+    uint32_t getFrameCount() const {
+        return frameCount;
+    }
+
+    /**
+     * @brief Read a frame into leds
+     *
+     * Delta frames are applied on top of leds, so leds must still hold the frame read last time.
+     * Keyframe animations are evaluated at the time of the frame and can be read in any order.
+     * Compressed frames skipped forward are decoded on the way, going back restarts from the nearest key frame.
+     *
+     * @param frame frame index, less than getFrameCount()
+     * @param leds buffer of the light
+     * @param count led count of the light
+     * @return true if the frame is read
+     */
+    bool readFrame(uint32_t frame, CRGB *leds, int count) {
+        if (frame >= frameCount) {
+            return false;
+        }
+        if (count > ledCount) {
+            fill_solid(leds + ledCount, count - ledCount, CRGB::Black);
+        }
+        if (format == FORMAT_KEYFRAME) {
+            evaluate(frame, leds, count);
+            return true;
+        }
+        uint32_t start = nextFrame;
+        if (frame < nextFrame || (frame > nextFrame && format == FORMAT_RGB)) {
+            if (!seekKeyFrame(frame, start)) {
+                nextFrame = UINT32_MAX;
+                return false;
+            }
+        }
+        for (; start <= frame; start++) {
+            if (!(format == FORMAT_RGB ? readRGBFrame(leds, count) : readRLEFrame(leds, count))) {
+                nextFrame = UINT32_MAX;
+                return false;
+            }
+        }
+        nextFrame = frame + 1;
+        return true;
+    }
+};
+
+#endif // __ANIMATIONFILE_HPP__
@@ -0,0 +1,212 @@
+#ifndef __ANIMATIONPARTITION_HPP__
+#define __ANIMATIONPARTITION_HPP__
+
+#include "config.h"
+
+#if defined(ESP32) && defined(ENABLE_ANIM_PARTITION)
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <ArduinoJson.h>
+#include <esp_partition.h>
+
+// 动画分区的名称和子类型, 需要与分区表一致
+#ifndef ANIM_PARTITION_NAME
+#define ANIM_PARTITION_NAME "anim"
+#endif
+#ifndef ANIM_PARTITION_SUBTYPE
+#define ANIM_PARTITION_SUBTYPE 0x40
+#endif
+
+#if ESP_IDF_VERSION_MAJOR >= 5
+typedef esp_partition_mmap_handle_t anim_mmap_handle_t;
+#define ANIM_MMAP_DATA ESP_PARTITION_MMAP_DATA
+#else
+typedef spi_flash_mmap_handle_t anim_mmap_handle_t;
+#define ANIM_MMAP_DATA SPI_FLASH_MMAP_DATA
+#endif
+
+/**
+ * ESP32 上存放动画的原始数据分区
+ *
+ * 整个分区启动时映射到地址空间, 播放时按指针直接读取, 不经过文件系统.
+ * 第一个扇区为目录, 以 "RGBP" 开始, 之后是依次追加的条目: 32 字节的名称, u32 位置, u32 大小.
+ * 动画从第二个扇区开始按扇区对齐依次存放, 内容与 animations 中的文件相同.
+ * 目录只追加不改写, 同名的动画以最后安装的为准, 清空整个分区后才能回收空间
+ */
+class AnimationPartition {
+public:
+    static constexpr size_t NAME_SIZE = 32;
+
+private:
+    static constexpr uint32_t SECTOR_SIZE = 4096;
+
+    struct Entry {
+        char name[NAME_SIZE];
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    static constexpr int MAX_ENTRIES = (SECTOR_SIZE - 4) / sizeof(Entry);
+
+    const esp_partition_t *partition;
+    const uint8_t *base;
+    anim_mmap_handle_t handle;
+
+    AnimationPartition() : partition(nullptr), base(nullptr), handle(0) {}
+
+    const Entry* entries() {
+        return (const Entry *) (base + 4);
+    }
+
+    bool isFormatted() {
+        return memcmp(base, "RGBP", 4) == 0;
+    }
+
+    // 空闲的条目为擦除后的 0xFF
+    int entryCount() {
+        if (!isFormatted()) {
+            return 0;
+        }
+        int count = 0;
+        while (count < MAX_ENTRIES && entries()[count].name[0] != (char) 0xFF) {
+            count++;
+        }
+        return count;
+    }
+
+    uint32_t usedSize() {
+        uint32_t end = SECTOR_SIZE;
+        for (int i = 0, count = entryCount(); i < count; i++) {
+            end = std::max(end, entries()[i].offset + entries()[i].size);
+        }
+        return (end + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE;
+    }
+
+public:
+    static AnimationPartition& instance() {
+        static AnimationPartition partition;
+        return partition;
+    }
+
+    /**
+     * @brief Find the partition and map it into the address space
+     *
+     * @return true if the partition is available
+     */
+    bool begin() {
+        partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+            (esp_partition_subtype_t) ANIM_PARTITION_SUBTYPE, ANIM_PARTITION_NAME);
+        if (!partition) {
+            Serial.println(F("Animation partition not found"));
+            return false;
+        }
+        const void *ptr;
+        if (esp_partition_mmap(partition, 0, partition->size, ANIM_MMAP_DATA, &ptr, &handle) != ESP_OK) {
+            Serial.println(F("Failed to map animation partition"));
+            partition = nullptr;
+            return false;
+        }
+        base = (const uint8_t *) ptr;
+        Serial.printf_P(PSTR("Animation partition: %u animations, %u/%u bytes\n"),
+            entryCount(), usedSize(), partition->size);
+        return true;
+    }
+
+    explicit operator bool() const {
+        return base != nullptr;
+    }
+
+    /**
+     * @brief Find an installed animation
+     *
+     * @param name animation name, the same as the file name in /animations
+     * @param size size of the animation
+     * @return const uint8_t* mapped data, nullptr if not installed
+     */
+    const uint8_t* find(const char *name, uint32_t &size) {
+        if (!base) {
+            return nullptr;
+        }
+        for (int i = entryCount() - 1; i >= 0; i--) {
+            const Entry &entry = entries()[i];
+            if (strncmp(entry.name, name, NAME_SIZE) == 0 && entry.offset + entry.size <= partition->size) {
+                size = entry.size;
+                return base + entry.offset;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Check if a name fits in a directory entry and is a plain file name in /animations
+     */
+    static bool isValidName(const char *name) {
+        size_t length = strlen(name);
+        // 0xFF 开头的条目会被当作空闲条目
+        return length > 0 && length < NAME_SIZE && name[0] != (char) 0xFF && !strchr(name, '/');
+    }
+
+    /**
+     * @brief Copy an animation file into the partition, must not be playing from the partition
+     *
+     * @param name animation name, see isValidName()
+     * @param file file to copy
+     * @return true if installed
+     */
+    bool install(const char *name, File &file) {
+        if (!base || !isValidName(name) || (!isFormatted() && !clear())) {
+            return false;
+        }
+        int index = entryCount();
+        uint32_t offset = usedSize();
+        uint32_t size = file.size();
+        uint32_t erase = (size + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE;
+        if (index >= MAX_ENTRIES || size == 0 || offset + erase > partition->size) {
+            Serial.println(F("No space in animation partition"));
+            return false;
+        }
+        if (esp_partition_erase_range(partition, offset, erase) != ESP_OK) {
+            return false;
+        }
+        uint8_t buffer[256];
+        for (uint32_t pos = 0; pos < size;) {
+            int read = file.read(buffer, sizeof(buffer));
+            if (read <= 0 || esp_partition_write(partition, offset + pos, buffer, read) != ESP_OK) {
+                return false;
+            }
+            pos += read;
+        }
+        // 数据写完后再写目录, 中途失败不会留下不完整的动画
+        Entry entry;
+        memset(&entry, 0, sizeof(entry));
+        strncpy(entry.name, name, NAME_SIZE - 1);
+        entry.offset = offset;
+        entry.size = size;
+        return esp_partition_write(partition, 4 + index * sizeof(Entry), &entry, sizeof(entry)) == ESP_OK;
+    }
+
+    /**
+     * @brief Remove all animations, must not be playing from the partition
+     */
+    bool clear() {
+        return base && esp_partition_erase_range(partition, 0, SECTOR_SIZE) == ESP_OK &&
+            esp_partition_write(partition, 0, "RGBP", 4) == ESP_OK;
+    }
+
+    void writeToJSON(JsonDocument &json) {
+        json["total"] = partition ? partition->size : 0;
+        json["used"] = base ? usedSize() : 0;
+        JsonArray array = json.createNestedArray("animations");
+        for (int i = 0, count = base ? entryCount() : 0; i < count; i++) {
+            uint32_t size;
+            if (find(entries()[i].name, size) == base + entries()[i].offset) { // 跳过被覆盖的旧版本
+                array.add(entries()[i].name);
+            }
+        }
+    }
+};
+
+#endif
+
+#endif // __ANIMATIONPARTITION_HPP__
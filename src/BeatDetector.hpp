@@ -0,0 +1,120 @@
+#ifndef __BEATDETECTOR_HPP__
+#define __BEATDETECTOR_HPP__
+
+#include <atomic>
+#include <Arduino.h>
+
+#include "config.h"
+
+// 节拍检测的灵敏度, 频谱通量超过近期平均值的多少倍算作节拍, 以 1/16 为单位
+#ifndef BEAT_THRESHOLD
+#define BEAT_THRESHOLD 24
+#endif
+// 估计速度的范围 (BPM), 检测到的间隔会折半或加倍到这个范围内
+#ifndef BEAT_MIN_BPM
+#define BEAT_MIN_BPM 60
+#endif
+#ifndef BEAT_MAX_BPM
+#define BEAT_MAX_BPM 180
+#endif
+
+/**
+ * 根据各频段的音量检测节拍并估计速度
+ *
+ * 每收到一次音量计算频谱通量, 即各频段音量上升量之和, 超过近期通量平均值的 BEAT_THRESHOLD/16 倍,
+ * 且距离上一个节拍不太近时判定为节拍. 相邻节拍的间隔折算到 BEAT_MIN_BPM~BEAT_MAX_BPM 后平滑得到速度,
+ * 连续几次与当前速度差别较大时改用新的速度.
+ * 音量为 Q15 定点数, 只由渲染端调用 feed, 速度可以在命令端读取
+ */
+template <int BANDS>
+class BeatDetector {
+private:
+    static constexpr int HISTORY = 32; // 按每秒 20 次约 1.6 秒
+    static constexpr uint32_t MIN_PERIOD = 60000000UL / BEAT_MAX_BPM;
+    static constexpr uint32_t MAX_PERIOD = 60000000UL / BEAT_MIN_BPM;
+    static constexpr uint32_t FLUX_FLOOR = (1 << 15) / 32; // 安静时的细小波动不算节拍
+    static constexpr uint32_t MAX_GAP = 2000000; // 超过 2 秒没有节拍则重新开始计算间隔 (us)
+
+    uint16_t lastVolume[BANDS];
+    uint32_t history[HISTORY];
+    uint32_t historySum;
+    int historyIndex;
+    uint32_t lastBeat; // 上一个节拍的时间 (us)
+    bool hasBeat;
+    uint8_t misses;    // 连续与当前速度不符的间隔数
+    std::atomic<uint32_t> period; // 节拍间隔 (us), 0 表示未知
+
+    void track(uint32_t interval) {
+        while (interval < MIN_PERIOD) {
+            interval *= 2;
+        }
+        while (interval > MAX_PERIOD) {
+            interval /= 2;
+        }
+        uint32_t current = period.load(std::memory_order_relaxed);
+        uint32_t diff = interval > current ? interval - current : current - interval;
+        if (current == 0 || (diff > current / 8 && ++misses >= 3)) {
+            period.store(interval, std::memory_order_relaxed);
+            misses = 0;
+        } else if (diff <= current / 8) {
+            period.store(current + ((int32_t) interval - (int32_t) current) / 4, std::memory_order_relaxed);
+            misses = 0;
+        }
+    }
+
+public:
+    BeatDetector() :
+        lastVolume{0}, history{0}, historySum(0), historyIndex(0), lastBeat(0), hasBeat(false), misses(0), period(0) {}
+
+    /**
+     * @brief Feed the volume of all bands
+     *
+     * @param volume Q15 volume of each band
+     * @param time arrival time in microseconds
+     * @return true if this sample is a beat
+     */
+    bool feed(const uint16_t *volume, uint32_t time) {
+        uint32_t flux = 0;
+        for (int i = 0; i < BANDS; i++) {
+            if (volume[i] > lastVolume[i]) {
+                flux += volume[i] - lastVolume[i];
+            }
+            lastVolume[i] = volume[i];
+        }
+        flux /= BANDS;
+
+        uint32_t average = historySum / HISTORY;
+        historySum += flux - history[historyIndex];
+        history[historyIndex] = flux;
+        historyIndex = (historyIndex + 1) % HISTORY;
+
+        if (hasBeat && time - lastBeat > MAX_GAP) {
+            hasBeat = false;
+        }
+        if (flux < FLUX_FLOOR || flux * 16 <= average * BEAT_THRESHOLD) {
+            return false;
+        }
+        if (hasBeat) {
+            uint32_t interval = time - lastBeat;
+            if (interval < MIN_PERIOD / 2) { // 同一个节拍的余波
+                return false;
+            }
+            track(interval);
+        }
+        lastBeat = time;
+        hasBeat = true;
+        return true;
+    }
+
+    /**
+     * @brief Get the estimated tempo, safe for both sides
+     *
+     * @return uint16_t beats per minute, 0 if unknown
+     */
+    uint16_t getBPM() {
+        uint32_t current = period.load(std::memory_order_relaxed);
+        return current > 0 ? (60000000UL + current / 2) / current : 0;
+    }
+};
+
+#endif // __BEATDETECTOR_HPP__
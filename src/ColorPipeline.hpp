@@ -0,0 +1,178 @@
+#ifndef __COLORPIPELINE_HPP__
+#define __COLORPIPELINE_HPP__
+
+#include <atomic>
+#include <math.h>
+#include <Arduino.h>
+#include <FastLED.h>
+
+#include "config.h"
+#include "utils.h"
+
+// 灯珠供电电压 (V)
+#ifndef LED_VOLTAGE
+#define LED_VOLTAGE 5
+#endif
+// 单颗灯珠红绿蓝三个通道满亮度时的电流 (mA), 默认按 WS2812B 计算
+#ifndef LED_CURRENT_MA
+#define LED_CURRENT_MA {16, 11, 15}
+#endif
+// 单颗灯珠不亮时的静态电流 (mA)
+#ifndef LED_IDLE_CURRENT_MA
+#define LED_IDLE_CURRENT_MA 1
+#endif
+// 功率限制的精度, 即不限制时的缩放比例
+#define POWER_LIMIT_ONE 0x10000
+// 功率限制最多压低到的比例, 静态电流已超过限制时保持这个亮度, 不至于全黑
+#define POWER_LIMIT_MIN (POWER_LIMIT_ONE / 16)
+
+/**
+ * 灯效到灯珠之间的颜色处理
+ *
+ * 伽马校正, 色温, 颜色校正和亮度合并成每个通道一张 256 项的查找表, 只在参数改变后的下一帧重建,
+ * 每帧输出时每个像素只需查三次表. 处理结果写到单独的输出缓冲, 灯效画在 light 中的内容保持不变.
+ * 参数由命令端修改, 查找表只由渲染端访问
+ *
+ * 查表的同时累加各通道的亮度估算整帧的电流, 超过 LED_MAX_POWER_MW 时立即按比例压低查找表的亮度并重新处理这一帧,
+ * 之后每帧缓慢恢复, 且只在恢复后预计仍留有余量时才提高, 所以亮度不会来回跳动.
+ * 灯珠太多, 仅静态电流就超过限制时无法满足限制, 亮度保持在 POWER_LIMIT_MIN, 启动时由 checkPowerLimit 提示
+ */
+class ColorPipeline {
+private:
+    uint8_t lut[3][256];
+    uint8_t brightness;
+    CRGB temperature;
+    CRGB correction;
+    std::atomic<bool> dirty;
+    uint32_t powerLimit; // 功率限制下亮度的缩放比例, POWER_LIMIT_ONE 为不限制, 仅渲染端访问
+    std::atomic<uint32_t> current; // 上一次输出的估算电流 (mA)
+
+    // 与 FastLED 的 computeAdjustment 和 scale8 相同, 关闭伽马校正且不限制功率时输出与 FastLED 一致
+    void rebuild() {
+        for (int i = 0; i < 3; i++) {
+            uint32_t scale = 0;
+            if (brightness > 0 && correction.raw[i] > 0 && temperature.raw[i] > 0) {
+                scale = ((uint32_t) correction.raw[i] + 1) * ((uint32_t) temperature.raw[i] + 1) * brightness / 0x10000 + 1;
+            }
+            for (int value = 0; value < 256; value++) {
+#ifdef LED_GAMMA
+                uint8_t linear = (uint8_t) (powf(value / 255.0f, LED_GAMMA) * 255.0f + 0.5f);
+#else
+                uint8_t linear = value;
+#endif
+                lut[i][value] = ((uint64_t) linear * scale * powerLimit) >> 24;
+            }
+        }
+    }
+
+    // 查表的舍入让每个通道最多少算 1, 加上两次整除, 估算电流最多偏低这么多 (mA)
+    static uint32_t roundingCurrent(int count) {
+        static const uint16_t CURRENT[3] = LED_CURRENT_MA;
+        return (uint32_t) count * (CURRENT[0] + CURRENT[1] + CURRENT[2]) / 255 + 2;
+    }
+
+    // 查表并返回估算电流 (mA)
+    uint32_t translate(const CRGB *in, CRGB *out, int count) {
+        static const uint16_t CURRENT[3] = LED_CURRENT_MA;
+        const uint8_t *r = lut[0], *g = lut[1], *b = lut[2];
+        uint32_t sumR = 0, sumG = 0, sumB = 0;
+        for (int i = 0; i < count; i++) {
+            sumR += out[i].r = r[in[i].r];
+            sumG += out[i].g = g[in[i].g];
+            sumB += out[i].b = b[in[i].b];
+        }
+        return (sumR * CURRENT[0] + sumG * CURRENT[1] + sumB * CURRENT[2]) / 255 +
+            (uint32_t) count * LED_IDLE_CURRENT_MA;
+    }
+
+public:
+    ColorPipeline() : brightness(255), temperature(UncorrectedTemperature), correction(UncorrectedColor), dirty(true),
+        powerLimit(POWER_LIMIT_ONE), current(0) {}
+
+    void setBrightness(uint8_t brightness) {
+        this->brightness = brightness;
+        dirty.store(true);
+    }
+
+    /**
+     * @brief Set the white point
+     *
+     * @param kelvin color temperature in kelvin
+     */
+    void setTemperature(uint32_t kelvin) {
+        temperature = CRGB(kelvin2rgb(kelvin));
+        dirty.store(true);
+    }
+
+    void setCorrection(const CRGB &correction) {
+        this->correction = correction;
+        dirty.store(true);
+    }
+
+    /**
+     * @brief Get the estimated current of the last output frame
+     *
+     * @return uint32_t current in mA
+     */
+    uint32_t getCurrent() {
+        return current.load();
+    }
+
+    /**
+     * @brief Warn if the idle current of count pixels alone exceeds the power limit, call once at startup
+     *
+     * @return false if the limit can not be met and brightness is held at POWER_LIMIT_MIN
+     */
+    bool checkPowerLimit(int count) {
+#ifdef LED_MAX_POWER_MW
+        uint32_t idle = (uint32_t) count * LED_IDLE_CURRENT_MA;
+        if (idle >= LED_MAX_POWER_MW / LED_VOLTAGE) {
+            Serial.printf_P(PSTR("Idle current %u mA of %d leds exceeds the power limit %u mA\n"),
+                (unsigned) idle, count, (unsigned) (LED_MAX_POWER_MW / LED_VOLTAGE));
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    /**
+     * @brief Convert a frame to output colors, called by the render side
+     *
+     * @param in pixels drawn by the effect
+     * @param out output buffer, must not overlap with in
+     * @param count number of pixels
+     * @return true if the power limit is being released and the frame should be output again
+     */
+    bool apply(const CRGB *in, CRGB *out, int count) {
+        if (dirty.load()) {
+            dirty.store(false); // 先清除标记, 重建过程中参数又被修改时下一帧会再重建
+            rebuild();
+        }
+        uint32_t total = translate(in, out, count);
+        bool releasing = false;
+#ifdef LED_MAX_POWER_MW
+        uint32_t idle = (uint32_t) count * LED_IDLE_CURRENT_MA;
+        uint32_t limit = LED_MAX_POWER_MW / LED_VOLTAGE;
+        uint32_t usable = limit > idle ? limit - idle : 0;
+        if (total > limit && powerLimit > POWER_LIMIT_MIN) {
+            // 查表结果不超过按比例缩放的值, 按估算电流加上舍入误差直接算出不超限的比例, 这一帧只需重新处理一次也不会超限输出
+            uint64_t scaled = (uint64_t) powerLimit * usable / (total - idle + roundingCurrent(count));
+            powerLimit = std::max<uint64_t>(std::min<uint64_t>(scaled, powerLimit - 1), POWER_LIMIT_MIN);
+            rebuild();
+            total = translate(in, out, count);
+        } else if (powerLimit < POWER_LIMIT_ONE) {
+            // 每帧提高约 3%, 且恢复后预计的电流低于限制的 15/16 时才提高, 留出余量避免在限制附近来回调整
+            uint32_t next = std::min<uint32_t>(powerLimit + powerLimit / 32 + 1, POWER_LIMIT_ONE);
+            if ((uint64_t) (total - idle) * next / std::max<uint32_t>(powerLimit, 1) <= usable / 16 * 15) {
+                powerLimit = next;
+                rebuild();
+                releasing = true;
+            }
+        }
+#endif
+        current.store(total);
+        return releasing;
+    }
+};
+
+#endif // __COLORPIPELINE_HPP__
@@ -0,0 +1,138 @@
+#ifndef __EFFECTHOLDER_HPP__
+#define __EFFECTHOLDER_HPP__
+
+#include <atomic>
+
+#include "LightEffect.hpp"
+
+/**
+ * 在命令处理和渲染回调之间共享当前灯效
+ *
+ * 命令端 (loop) 是唯一的写者, 新灯效构造好后用一次原子写入发布, 旧灯效放入待回收列表.
+ * 渲染端每帧开始时 acquire 并登记正在使用的灯效, 结束时 release,
+ * 命令端只回收渲染端没有在用的旧灯效, 所以双方都不会阻塞, 正在渲染的帧也不会被打断.
+ * 只用到原子读写, ESP8266 上也不需要 libatomic.
+ *
+ * 灯效都构造在内部固定的几个位置上, 切换灯效不会分配堆内存
+ */
+template <typename LIGHT>
+class EffectHolder {
+private:
+    // 渲染端同时最多只会使用一个旧灯效, 所以两个位置就够了
+    static constexpr int MAX_RETIRED = 2;
+    // 当前灯效, 渲染中的旧灯效和正在构造的新灯效各占一个位置
+    static constexpr int SLOT_COUNT = 3;
+
+    struct alignas(EffectStorage<LIGHT>::align) Slot {
+        uint8_t data[EffectStorage<LIGHT>::size];
+    };
+
+    Slot slots[SLOT_COUNT];
+    std::atomic<Effect*> current;
+    std::atomic<Effect*> rendering; // 渲染端正在使用的灯效
+    Effect *retired[MAX_RETIRED];   // 仅命令端访问
+
+    bool isUsed(void *slot) {
+        if (slot == current.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        for (int i = 0; i < MAX_RETIRED; i++) {
+            if (slot == retired[i]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    EffectHolder() : current(nullptr), rendering(nullptr), retired{} {}
+
+    ~EffectHolder() {
+        collect();
+        Effect *effect = current.load();
+        if (effect) {
+            effect->~Effect();
+        }
+    }
+
+    /**
+     * @brief Get the current effect, only for the command side
+     */
+    Effect* get() {
+        return current.load(std::memory_order_relaxed);
+    }
+
+    Effect* operator->() {
+        return get();
+    }
+
+    /**
+     * @brief Get a free slot to construct the next effect in, only for the command side
+     *
+     * @return void* storage large enough for any effect, valid until the next publish
+     */
+    void* allocate() {
+        collect();
+        for (int i = 0; i < SLOT_COUNT; i++) {
+            if (!isUsed(&slots[i])) {
+                return &slots[i];
+            }
+        }
+        return nullptr; // 不会发生, 回收后最多只有当前和渲染中的两个位置被占用
+    }
+
+    /**
+     * @brief Replace the current effect, only for the command side
+     *
+     * @param effect effect constructed in the slot returned by allocate()
+     */
+    void publish(Effect *effect) {
+        collect();
+        Effect *old = current.load(std::memory_order_relaxed);
+        current.store(effect);
+        for (int i = 0; old && i < MAX_RETIRED; i++) {
+            if (!retired[i]) {
+                retired[i] = old;
+                old = nullptr;
+            }
+        }
+        collect();
+    }
+
+    /**
+     * @brief Destroy the retired effects that are no longer rendered, only for the command side
+     *
+     * @return true if no retired effect is left
+     */
+    bool collect() {
+        bool empty = true;
+        for (int i = 0; i < MAX_RETIRED; i++) {
+            if (retired[i] && retired[i] != rendering.load()) {
+                retired[i]->~Effect();
+                retired[i] = nullptr;
+            }
+            empty = empty && !retired[i];
+        }
+        return empty;
+    }
+
+    /**
+     * @brief Take the current effect for rendering a frame, only for the render side
+     *
+     * @return Effect* effect that stays valid until release()
+     */
+    Effect* acquire() {
+        Effect *effect;
+        do { // 登记后再确认一次, 避免登记前已被替换并回收
+            effect = current.load();
+            rendering.store(effect);
+        } while (effect != current.load());
+        return effect;
+    }
+
+    void release() {
+        rendering.store(nullptr);
+    }
+};
+
+#endif // __EFFECTHOLDER_HPP__
@@ -0,0 +1,113 @@
+#ifndef __FIXEDFFT_HPP__
+#define __FIXEDFFT_HPP__
+
+#include <math.h>
+#include <Arduino.h>
+
+/**
+ * 定点数实数 FFT
+ *
+ * N 个实数样本两两组成 N/2 个复数做基 2 的复数 FFT, 再拆分出实数序列的频谱, 计算量约为直接做 N 点的一半.
+ * 数据为 Q15 定点数, 每一级蝶形运算后右移一位防止溢出, 所以结果缩小了 N/2 倍.
+ * 只输出各频点的幅值, 用 max + min * 3/8 近似代替开方
+ */
+template <int N>
+class FixedFFT {
+private:
+    static_assert(N >= 16 && (N & (N - 1)) == 0, "N must be a power of 2");
+    static constexpr int M = N / 2;
+
+    int16_t sineTable[N / 4 + 1]; // 四分之一周期的正弦表
+    int16_t re[M];
+    int16_t im[M];
+
+    // sin(2 * PI * k / N)
+    int16_t sine(int k) {
+        k &= N - 1;
+        if (k < N / 4) {
+            return sineTable[k];
+        } else if (k < N / 2) {
+            return sineTable[N / 2 - k];
+        } else if (k < N * 3 / 4) {
+            return -sineTable[k - N / 2];
+        }
+        return -sineTable[N - k];
+    }
+
+    int16_t cosine(int k) {
+        return sine(k + N / 4);
+    }
+
+    static uint32_t magnitude(int32_t x, int32_t y) {
+        uint32_t a = abs(x), b = abs(y);
+        return a > b ? a + b * 3 / 8 : b + a * 3 / 8;
+    }
+
+    void transform() {
+        for (int i = 1, j = 0; i < M; i++) { // 按位倒序重排
+            int bit = M >> 1;
+            for (; j & bit; bit >>= 1) {
+                j ^= bit;
+            }
+            j |= bit;
+            if (i < j) {
+                std::swap(re[i], re[j]);
+                std::swap(im[i], im[j]);
+            }
+        }
+        for (int size = 2; size <= M; size <<= 1) {
+            int half = size / 2;
+            int step = N / size; // M 点的旋转因子对应 N 点正弦表中的间隔
+            for (int start = 0; start < M; start += size) {
+                for (int j = 0; j < half; j++) {
+                    int32_t wr = cosine(j * step);
+                    int32_t wi = -sine(j * step);
+                    int a = start + j, b = a + half;
+                    int32_t tr = (re[b] * wr - im[b] * wi) >> 15;
+                    int32_t ti = (re[b] * wi + im[b] * wr) >> 15;
+                    re[b] = (re[a] - tr) >> 1;
+                    im[b] = (im[a] - ti) >> 1;
+                    re[a] = (re[a] + tr) >> 1;
+                    im[a] = (im[a] + ti) >> 1;
+                }
+            }
+        }
+    }
+
+public:
+    FixedFFT() {
+        for (int i = 0; i <= N / 4; i++) {
+            sineTable[i] = lroundf(sinf(2.0f * (float) M_PI * i / N) * 32767.0f);
+        }
+    }
+
+    /**
+     * @brief Compute the magnitude spectrum of real samples
+     *
+     * @param input N samples in Q15, already windowed
+     * @param output N/2 magnitudes, output[k] is the bin of k * sampleRate / N, DC is set to 0
+     */
+    void process(const int16_t *input, uint32_t *output) {
+        for (int i = 0; i < M; i++) {
+            re[i] = input[i * 2];
+            im[i] = input[i * 2 + 1];
+        }
+        transform();
+        output[0] = 0;
+        for (int k = 1; k < M; k++) {
+            // 偶数样本的频谱 E = (Z[k] + conj(Z[M-k])) / 2, 奇数样本的频谱 O = (Z[k] - conj(Z[M-k])) / 2i
+            int32_t er = (re[k] + re[M - k]) / 2;
+            int32_t ei = (im[k] - im[M - k]) / 2;
+            int32_t orr = (im[k] + im[M - k]) / 2;
+            int32_t oi = (re[M - k] - re[k]) / 2;
+            // X[k] = E + O * e^(-2 * PI * i * k / N)
+            int32_t wr = cosine(k);
+            int32_t wi = -sine(k);
+            int32_t xr = er + ((orr * wr - oi * wi) >> 15);
+            int32_t xi = ei + ((orr * wi + oi * wr) >> 15);
+            output[k] = magnitude(xr, xi);
+        }
+    }
+};
+
+#endif // __FIXEDFFT_HPP__
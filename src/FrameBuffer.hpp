@@ -0,0 +1,23 @@
+#ifndef __FRAMEBUFFER_HPP__
+#define __FRAMEBUFFER_HPP__
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+#include "config.h"
+#include "Mailbox.hpp"
+
+// 双核芯片上由另一个核心负责刷新灯珠, 渲染和输出可以同时进行
+#if !defined(DISABLE_DUAL_CORE_OUTPUT) && \
+    ((defined(ESP32) && !defined(CONFIG_FREERTOS_UNICORE)) || defined(PICO_RP2040))
+#define DUAL_CORE_OUTPUT
+#endif
+
+/**
+ * 渲染与输出之间的三缓冲, 渲染端为生产者, 输出端为消费者.
+ * 上位机发送的自定义帧和实时灯光数据也用它从命令端传给渲染端, 此时命令端为生产者, 渲染端为消费者
+ */
+template <int COUNT>
+using FrameBuffer = Mailbox<CRGB[COUNT]>;
+
+#endif // __FRAMEBUFFER_HPP__
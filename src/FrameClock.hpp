@@ -0,0 +1,134 @@
+#ifndef __FRAMECLOCK_HPP__
+#define __FRAMECLOCK_HPP__
+
+#include <Arduino.h>
+
+#include "config.h"
+
+// 单颗灯珠 24 位数据的传输时长, 默认按 WS2812B 的 800kHz 计算
+#ifndef LED_DATA_TIME_US
+#define LED_DATA_TIME_US 30
+#endif
+// 每帧结束后的锁存时长
+#ifndef LED_RESET_TIME_US
+#define LED_RESET_TIME_US 280
+#endif
+
+/**
+ * 无累积误差的帧时钟
+ *
+ * 第 n 帧的截止时间为 start + n * 1000000 / frameRate, 整数除法的余数不会累积,
+ * 所以 60Hz 就是 60Hz. 错过的帧直接跳过, 而不是排队补渲染
+ */
+class FrameClock {
+private:
+    uint16_t frameRate;
+    uint32_t startTime;     // 第 0 帧的时间 (us)
+    uint32_t frameIndex;    // 下一帧的序号
+    uint32_t lastFrameTime; // 上一帧的实际渲染时间 (us)
+    uint32_t skippedFrames;
+    uint32_t renderedFrames;
+
+    uint32_t deadline(uint32_t index) {
+        return startTime + (uint32_t) ((uint64_t) index * 1000000 / frameRate);
+    }
+
+public:
+    FrameClock() :
+        frameRate(60), startTime(0), frameIndex(0), lastFrameTime(0), skippedFrames(0), renderedFrames(0) {}
+
+    /**
+     * @brief Get the max refresh rate that the LED data line can reach
+     *
+     * @param ledCount number of LEDs on the data line
+     * @return uint16_t max refresh rate in Hz
+     */
+    static uint16_t maxFrameRate(int ledCount) {
+        return 1000000 / ((uint32_t) ledCount * LED_DATA_TIME_US + LED_RESET_TIME_US);
+    }
+
+    /**
+     * @brief Restart the clock, the first frame is due immediately
+     *
+     * @param frameRate refresh rate in Hz, must be greater than 0
+     * @param now current time in microseconds
+     */
+    void start(uint16_t frameRate, uint32_t now) {
+        this->frameRate = frameRate;
+        startTime = now;
+        frameIndex = 0;
+        lastFrameTime = now;
+    }
+
+    /**
+     * @brief Check whether a frame is due, skipping frames that were missed
+     *
+     * @param now current time in microseconds
+     * @param deltaTime set to the time elapsed since the last frame in microseconds
+     * @return true if a frame should be rendered now
+     */
+    bool tick(uint32_t now, uint32_t &deltaTime) {
+        int32_t late = now - deadline(frameIndex);
+        if (late < 0) {
+            return false;
+        }
+        uint32_t missed = (uint64_t) late * frameRate / 1000000;
+        frameIndex += missed + 1;
+        skippedFrames += missed;
+        renderedFrames++;
+        if (frameIndex >= frameRate) { // 每秒换一次基准, 避免序号溢出
+            startTime += frameIndex / frameRate * 1000000;
+            frameIndex %= frameRate;
+        }
+        deltaTime = now - lastFrameTime;
+        lastFrameTime = now;
+        return true;
+    }
+
+    /**
+     * @brief Skip the frames due before the given time, they are not counted as missed
+     *
+     * @param wait microseconds since the last rendered frame
+     */
+    void idle(uint32_t wait) {
+        int32_t time = lastFrameTime + wait - startTime;
+        if (time > 0) {
+            frameIndex = std::max<uint32_t>(frameIndex, ((uint64_t) time * frameRate + 999999) / 1000000);
+        }
+    }
+
+    /**
+     * @brief Make a frame due immediately after the clock has been idle, keeping the time of the last frame
+     *
+     * @param now current time in microseconds
+     */
+    void resume(uint32_t now) {
+        startTime = now;
+        frameIndex = 0;
+    }
+
+    /**
+     * @brief Get the time until the next frame is due
+     *
+     * @param now current time in microseconds
+     * @return uint32_t microseconds until the next frame, 0 if already due
+     */
+    uint32_t untilNextFrame(uint32_t now) {
+        int32_t remain = deadline(frameIndex) - now;
+        return remain > 0 ? remain : 0;
+    }
+
+    uint16_t getFrameRate() {
+        return frameRate;
+    }
+
+    uint32_t getSkippedFrames() {
+        return skippedFrames;
+    }
+
+    uint32_t getRenderedFrames() {
+        return renderedFrames;
+    }
+};
+
+#endif // __FRAMECLOCK_HPP__
@@ -0,0 +1,163 @@
+#ifndef __I2SDMACONTROLLER_HPP__
+#define __I2SDMACONTROLLER_HPP__
+
+#include "config.h"
+
+#if defined(LED_OUTPUT_DMA)
+#if !defined(ESP8266)
+#error "LED_OUTPUT_DMA is only supported on ESP8266"
+#endif
+
+#include <Arduino.h>
+#include <FastLED.h>
+extern "C" {
+#include <ets_sys.h>
+#include <i2s_reg.h>
+}
+
+// I2S 数据输出引脚, 由硬件决定
+#define I2S_DATA_PIN 3
+
+/**
+ * ESP8266 的 I2S DMA 输出
+ *
+ * 每个数据位用 4 个 I2S 位表示 (1 -> 1110, 0 -> 1000), 160MHz / 48 约为 3.33MHz, 即每位 1.2us.
+ * show 时只把像素编码进 DMA 缓冲区就返回, 之后由 DMA 在后台输出, 不需要关中断.
+ * 空闲时 DMA 循环输出一段低电平, 开始新的一帧时把它链接到数据上, 数据输出完后由中断断开
+ */
+template <int COUNT, EOrder RGB_ORDER = GRB>
+class I2SDmaController : public CPixelLEDController<RGB_ORDER> {
+private:
+    // 与 SDK 中的 slc_queue_item 相同
+    struct SlcDescriptor {
+        uint32_t blocksize : 12;
+        uint32_t datalen : 12;
+        uint32_t unused : 5;
+        uint32_t sub_sof : 1;
+        uint32_t eof : 1;
+        uint32_t owner : 1;
+        uint8_t *buffer;
+        SlcDescriptor *next;
+    };
+
+    static constexpr int CLOCK_DIV = 3;
+    static constexpr int BCK_DIV = 16;
+    static constexpr int DATA_SIZE = COUNT * 3 * sizeof(uint32_t);
+    static constexpr int BLOCK_SIZE = 4092; // 描述符最多 4095 字节, 且需 4 字节对齐
+    static constexpr int DATA_BLOCKS = (DATA_SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    static constexpr int IDLE_SIZE = 128; // 约 300us 的低电平, 同时作为复位信号
+
+    uint32_t buffer[COUNT * 3];
+    uint32_t idle[IDLE_SIZE / sizeof(uint32_t)];
+    SlcDescriptor descriptors[DATA_BLOCKS + 1]; // 最后一个为空闲描述符
+    volatile bool busy;
+
+    static constexpr uint16_t pattern(uint8_t bits) {
+        return (bits & 0x8 ? 0xE000 : 0x8000) | (bits & 0x4 ? 0x0E00 : 0x0800) |
+            (bits & 0x2 ? 0x00E0 : 0x0080) | (bits & 0x1 ? 0x000E : 0x0008);
+    }
+
+    static uint32_t encode(uint8_t value) {
+        static const uint16_t patterns[16] = {
+            pattern(0), pattern(1), pattern(2), pattern(3), pattern(4), pattern(5), pattern(6), pattern(7),
+            pattern(8), pattern(9), pattern(10), pattern(11), pattern(12), pattern(13), pattern(14), pattern(15)
+        };
+        // I2S 先输出高半字, 所以高 4 位放在高半字
+        return (uint32_t) patterns[value >> 4] << 16 | patterns[value & 0xF];
+    }
+
+    static void IRAM_ATTR onDmaInterrupt(void *arg) {
+        I2SDmaController *self = (I2SDmaController *) arg;
+        uint32_t status = SLCIS;
+        SLCIC = 0xFFFFFFFF;
+        if (status & SLCIRXEOF) {
+            SlcDescriptor *idle = &self->descriptors[DATA_BLOCKS];
+            idle->next = idle;
+            self->busy = false;
+        }
+    }
+
+public:
+    I2SDmaController() : buffer(), idle(), busy(false) {}
+
+    virtual void init() {
+        for (int i = 0; i < DATA_BLOCKS; i++) {
+            int size = DATA_SIZE - i * BLOCK_SIZE;
+            if (size > BLOCK_SIZE) {
+                size = BLOCK_SIZE;
+            }
+            SlcDescriptor &desc = descriptors[i];
+            desc.blocksize = size;
+            desc.datalen = size;
+            desc.unused = 0;
+            desc.sub_sof = 0;
+            desc.eof = i == DATA_BLOCKS - 1; // 只有最后一块数据输出完时产生中断
+            desc.owner = 1;
+            desc.buffer = (uint8_t *) buffer + i * BLOCK_SIZE;
+            desc.next = &descriptors[i + 1];
+        }
+        SlcDescriptor &desc = descriptors[DATA_BLOCKS];
+        desc.blocksize = IDLE_SIZE;
+        desc.datalen = IDLE_SIZE;
+        desc.unused = 0;
+        desc.sub_sof = 0;
+        desc.eof = 0;
+        desc.owner = 1;
+        desc.buffer = (uint8_t *) idle;
+        desc.next = &desc;
+
+        // 初始化 SLC, 向 I2S 发送数据用的是 RX 链路, TX 链路不使用但需要一个有效的描述符
+        SLCC0 |= SLCRXLR | SLCTXLR;
+        SLCC0 &= ~(SLCRXLR | SLCTXLR);
+        SLCIC = 0xFFFFFFFF;
+        SLCC0 &= ~(SLCMM << SLCM);
+        SLCC0 |= (1 << SLCM);
+        SLCRXDC |= SLCBINR | SLCBTNR;
+        SLCRXDC &= ~(SLCBRXFE | SLCBRXEM | SLCBRXFM);
+        SLCTXL &= ~(SLCTXLAM << SLCTXLA);
+        SLCTXL |= (uint32_t) &desc << SLCTXLA;
+        SLCRXL &= ~(SLCRXLAM << SLCRXLA);
+        SLCRXL |= (uint32_t) &desc << SLCRXLA;
+        ETS_SLC_INTR_DISABLE();
+        SLCIC = 0xFFFFFFFF;
+        SLCIE = SLCIRXEOF;
+        ETS_SLC_INTR_ATTACH(onDmaInterrupt, this);
+        ETS_SLC_INTR_ENABLE();
+        SLCTXL |= SLCTXLS;
+        SLCRXL |= SLCRXLS;
+
+        // 初始化 I2S, 16 位双声道, 使用 DMA
+        pinMode(I2S_DATA_PIN, FUNCTION_1);
+        I2S_CLK_ENABLE();
+        I2SIC = 0x3F;
+        I2SIE = 0;
+        I2SC &= ~(I2SRST);
+        I2SC |= I2SRST;
+        I2SC &= ~(I2SRST);
+        I2SFC &= ~(I2SDE | (I2STXFMM << I2STXFM) | (I2SRXFMM << I2SRXFM));
+        I2SFC |= I2SDE;
+        I2SCC &= ~((I2STXCMM << I2STXCM) | (I2SRXCMM << I2SRXCM));
+        I2SC &= ~(I2STSM | I2SRSM | (I2SBMM << I2SBM) | (I2SBDM << I2SBD) | (I2SCDM << I2SCD));
+        I2SC |= I2SRF | I2SMR | I2SRSM | I2SRMS | ((BCK_DIV & I2SBDM) << I2SBD) | ((CLOCK_DIV & I2SCDM) << I2SCD);
+        I2SC |= I2STXS;
+    }
+
+    virtual void showPixels(PixelController<RGB_ORDER> &pixels) {
+        // 帧时钟已按灯珠传输时长限制了刷新率, 一般不会等待, 在 Ticker 回调中不能 yield
+        while (busy);
+        uint32_t *data = buffer;
+        while (pixels.has(1)) {
+            *data++ = encode(pixels.loadAndScale0());
+            *data++ = encode(pixels.loadAndScale1());
+            *data++ = encode(pixels.loadAndScale2());
+            pixels.advanceData();
+            pixels.stepDithering();
+        }
+        busy = true;
+        descriptors[DATA_BLOCKS].next = &descriptors[0];
+    }
+};
+
+#endif
+
+#endif // __I2SDMACONTROLLER_HPP__
@@ -0,0 +1,279 @@
+#ifndef __LATENCYTRACKER_HPP__
+#define __LATENCYTRACKER_HPP__
+
+#include "config.h"
+
+#ifdef ENABLE_LATENCY_TRACE
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "Mailbox.hpp"
+
+enum LatencyStream : uint8_t {
+    LATENCY_COMMAND,  // 改变灯光的文本命令
+    LATENCY_CUSTOM,   // 自定义灯效的像素
+    LATENCY_MUSIC,    // 音乐律动的音量
+    LATENCY_REALTIME, // UDP 和串口的实时灯光数据
+    LATENCY_STREAM_COUNT,
+};
+
+enum LatencyStage : uint8_t {
+    LATENCY_RECEIVE, // 收到消息到发布给渲染端
+    LATENCY_QUEUE,   // 发布到被某一帧取走
+    LATENCY_RENDER,  // 灯效更新和颜色处理
+    LATENCY_OUTPUT,  // 交给输出到刷新完成
+    LATENCY_STAGE_COUNT,
+};
+
+/**
+ * 按 2 的幂分桶的延迟直方图, 第一个桶为 16us 以下, 最后一个桶为 256ms 以上
+ */
+class LatencyHistogram {
+public:
+    static constexpr int BUCKETS = 16;
+    static constexpr int MIN_SHIFT = 4;
+
+    uint32_t buckets[BUCKETS];
+    uint32_t count;
+    uint32_t max;
+    uint64_t sum;
+
+    LatencyHistogram() {
+        reset();
+    }
+
+    void reset() {
+        memset(buckets, 0, sizeof(buckets));
+        count = 0;
+        max = 0;
+        sum = 0;
+    }
+
+    void add(uint32_t us) {
+        int bucket = us < (1U << MIN_SHIFT) ? 0 : 32 - MIN_SHIFT - __builtin_clz(us);
+        buckets[std::min(bucket, BUCKETS - 1)]++;
+        count++;
+        max = std::max(max, us);
+        sum += us;
+    }
+
+    // 取所在桶的上界, 不超过最大值
+    uint32_t percentile(int percent) {
+        uint32_t target = (count * percent + 99) / 100;
+        uint32_t total = 0;
+        for (int i = 0; i < BUCKETS - 1; i++) {
+            total += buckets[i];
+            if (total >= target) {
+                return std::min((1UL << (i + MIN_SHIFT)) - 1, (unsigned long) max);
+            }
+        }
+        return max;
+    }
+};
+
+/**
+ * 记录实时输入从收到到灯珠刷新完成的延迟
+ *
+ * 命令端发布输入后调用 received, 渲染端每帧开始时 beginFrame 取走各路输入的最新记录,
+ * 颜色处理后 endRender 把记录随帧交给输出端, 刷新完成后 shown 记入直方图, 并交回命令端由 poll 回复发送端.
+ * 各阶段之间都用只保留最新值的信箱传递, 与输入和帧本身的信箱一样, 被新数据替换的记录直接丢弃.
+ * 记录与数据分别发布, 刚好在取走数据后到达的新记录会被算到这一帧上, 只影响个别样本
+ */
+class LatencyTracker {
+public:
+    static constexpr int8_t NO_REPLY = -2;   // 不回复发送端
+    static constexpr int8_t SERIAL_REPLY = -1; // 回复到串口, 否则为 WebSocket 客户端编号
+
+private:
+    struct Trace {
+        uint32_t tag;      // 发送端附带的序号, 回复时原样带回
+        int8_t client;
+        uint32_t time;     // 当前阶段开始的时间 (us)
+        uint32_t stages[LATENCY_STAGE_COUNT];
+    };
+
+    struct Frame {
+        uint8_t streams;   // 这一帧包含哪些输入
+        Trace traces[LATENCY_STREAM_COUNT];
+    };
+
+    Mailbox<Trace> inputs[LATENCY_STREAM_COUNT];
+    Mailbox<Frame> frames;  // 渲染端到输出端
+    Mailbox<Frame> replies; // 输出端到命令端
+    LatencyHistogram histograms[LATENCY_STREAM_COUNT][LATENCY_STAGE_COUNT];
+
+    static const char* streamName(int stream) {
+        static const char *names[LATENCY_STREAM_COUNT] = {"command", "custom", "music", "realtime"};
+        return names[stream];
+    }
+
+    static const char* stageName(int stage) {
+        static const char *names[LATENCY_STAGE_COUNT] = {"receive", "queue", "render", "output"};
+        return names[stage];
+    }
+
+    // 每个阶段结束时记下耗时, 并开始下一个阶段
+    static void advance(Frame &frame, LatencyStage stage, uint32_t now) {
+        for (int i = 0; i < LATENCY_STREAM_COUNT; i++) {
+            if (frame.streams & (1 << i)) {
+                frame.traces[i].stages[stage] = now - frame.traces[i].time;
+                frame.traces[i].time = now;
+            }
+        }
+    }
+
+public:
+    /**
+     * @brief Record an input that has just been published, only for the command side
+     *
+     * @param stream which input
+     * @param start time the input was received in microseconds
+     * @param tag sequence number from the sender
+     * @param client where to reply when the input is displayed, NO_REPLY to not reply
+     */
+    void received(LatencyStream stream, uint32_t start, uint32_t tag = 0, int8_t client = NO_REPLY) {
+        Trace &trace = inputs[stream].backBuffer();
+        trace.tag = tag;
+        trace.client = client;
+        trace.time = micros();
+        trace.stages[LATENCY_RECEIVE] = trace.time - start;
+        inputs[stream].publish();
+    }
+
+    /**
+     * @brief Take the inputs that this frame is going to render, only for the render side
+     */
+    void beginFrame() {
+        uint32_t now = micros();
+        Frame &frame = frames.backBuffer();
+        frame.streams = 0;
+        for (int i = 0; i < LATENCY_STREAM_COUNT; i++) {
+            if (inputs[i].acquire()) {
+                frame.traces[i] = inputs[i].frontBuffer();
+                frame.streams |= 1 << i;
+            }
+        }
+        advance(frame, LATENCY_QUEUE, now);
+    }
+
+    /**
+     * @brief Hand the inputs of this frame to the output, only for the render side
+     */
+    void endRender() {
+        Frame &frame = frames.backBuffer();
+        if (frame.streams) {
+            advance(frame, LATENCY_RENDER, micros());
+            frames.publish();
+        }
+    }
+
+    /**
+     * @brief Record the inputs of the frame that has just been shown, only for the output side
+     */
+    void shown() {
+        if (!frames.acquire()) {
+            return;
+        }
+        Frame &frame = frames.frontBuffer();
+        advance(frame, LATENCY_OUTPUT, micros());
+        bool reply = false;
+        for (int i = 0; i < LATENCY_STREAM_COUNT; i++) {
+            if (frame.streams & (1 << i)) {
+                for (int j = 0; j < LATENCY_STAGE_COUNT; j++) {
+                    histograms[i][j].add(frame.traces[i].stages[j]);
+                }
+                reply |= frame.traces[i].client != NO_REPLY;
+            }
+        }
+        if (reply) {
+            replies.backBuffer() = frame;
+            replies.publish();
+        }
+    }
+
+    /**
+     * @brief Reply "SHOWN,tag,receive,queue,render,output" in microseconds to the senders, only for the command side
+     *
+     * @param reply function called with the client and the message
+     */
+    template <typename F>
+    void poll(F reply) {
+        if (!replies.acquire()) {
+            return;
+        }
+        Frame &frame = replies.frontBuffer();
+        for (int i = 0; i < LATENCY_STREAM_COUNT; i++) {
+            Trace &trace = frame.traces[i];
+            if (!(frame.streams & (1 << i)) || trace.client == NO_REPLY) {
+                continue;
+            }
+            char str[64];
+            snprintf_P(str, sizeof(str), PSTR("SHOWN,%u,%u,%u,%u,%u"), (unsigned) trace.tag,
+                (unsigned) trace.stages[LATENCY_RECEIVE], (unsigned) trace.stages[LATENCY_QUEUE],
+                (unsigned) trace.stages[LATENCY_RENDER], (unsigned) trace.stages[LATENCY_OUTPUT]);
+            reply(trace.client, str);
+        }
+    }
+
+    /**
+     * @brief Write average, p50, p99 and max of each stage, or the buckets of one stream
+     *
+     * @param json document to write into
+     * @param stream stream to write the buckets of, negative for the summary of all streams
+     */
+    void writeToJSON(JsonDocument &json, int stream = -1) {
+        for (int i = 0; i < LATENCY_STREAM_COUNT; i++) {
+            if ((stream >= 0 && i != stream) || (stream < 0 && histograms[i][0].count == 0)) {
+                continue;
+            }
+            JsonObject object = json.createNestedObject(streamName(i));
+            object["count"] = histograms[i][0].count;
+            for (int j = 0; j < LATENCY_STAGE_COUNT; j++) {
+                LatencyHistogram &histogram = histograms[i][j];
+                JsonArray array = object.createNestedArray(stageName(j));
+                if (stream >= 0) {
+                    for (int k = 0; k < LatencyHistogram::BUCKETS; k++) {
+                        array.add(histogram.buckets[k]);
+                    }
+                } else if (histogram.count > 0) {
+                    array.add((uint32_t) (histogram.sum / histogram.count));
+                    array.add(histogram.percentile(50));
+                    array.add(histogram.percentile(99));
+                    array.add(histogram.max);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Find a stream by name
+     *
+     * @return int stream index, -1 if not found
+     */
+    static int findStream(const char *name) {
+        for (int i = 0; i < LATENCY_STREAM_COUNT; i++) {
+            if (strcmp(name, streamName(i)) == 0) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * @brief Clear all histograms, only for the command side
+     *
+     * Counts being added by the output side at the same time may be lost, which is fine for statistics.
+     */
+    void reset() {
+        for (int i = 0; i < LATENCY_STREAM_COUNT; i++) {
+            for (int j = 0; j < LATENCY_STAGE_COUNT; j++) {
+                histograms[i][j].reset();
+            }
+        }
+    }
+};
+
+#endif
+
+#endif // __LATENCYTRACKER_HPP__
@@ -13,12 +13,70 @@ public:
     virtual int count() = 0;
 };
 
+/**
+ * 按逻辑顺序遍历的一组灯珠, 如面板的一行或灯盘的一圈
+ *
+ * 第 k 个灯珠的下标为 start + k * step, 如果有查找表则再经过查找表转换为实际下标
+ */
+class PixelRange {
+private:
+    CRGB *leds;
+    const uint16_t *map; // 存放在 Flash 中的查找表, 可为空
+    int start;
+    int step;
+    int length;
+
+public:
+    class Iterator {
+    private:
+        const PixelRange &range;
+        int index;
+
+    public:
+        Iterator(const PixelRange &range, int index) : range(range), index(index) {}
+
+        CRGB &operator*() const {
+            return range[index];
+        }
+
+        Iterator &operator++() {
+            index++;
+            return *this;
+        }
+
+        bool operator!=(const Iterator &other) const {
+            return index != other.index;
+        }
+    };
+
+    PixelRange(CRGB *leds, const uint16_t *map, int start, int step, int length) :
+        leds(leds), map(map), start(start), step(step), length(length) {}
+
+    int size() const {
+        return length;
+    }
+
+    CRGB &operator[](int k) const {
+        int i = start + k * step;
+        return leds[map ? pgm_read_word(map + i) : i];
+    }
+
+    Iterator begin() const {
+        return Iterator(*this, 0);
+    }
+
+    Iterator end() const {
+        return Iterator(*this, length);
+    }
+};
+
 template <int COUNT, bool REVERSE>
 class LightStrip : public Light {
 private:
     CRGB leds[COUNT];
 
 public:
+    static constexpr int led_count = COUNT;
     static constexpr int music_bands = 1;
 
     CRGB *data() override {
@@ -40,6 +98,10 @@ public:
             return leds[i];
         }
     }
+
+    PixelRange all() {
+        return REVERSE ? PixelRange(leds, nullptr, COUNT - 1, -1, COUNT) : PixelRange(leds, nullptr, 0, 1, COUNT);
+    }
 };
 
 enum LightPanelArrangement {
@@ -54,9 +116,27 @@ enum LightPanelArrangement {
 template <int X_COUNT, int Y_COUNT, int ARRANGEMENT>
 class LightPanel : public Light {
 private:
+    // 坐标 (x, y) 对应的灯珠下标, 查找表按 y * X_COUNT + x 排列
+    struct IndexMap {
+        static constexpr int size = X_COUNT * Y_COUNT;
+
+        // u, v 为按接线方向排列的坐标, 蛇形和镜像都会反转 u
+        static constexpr uint16_t index(int u, int v, int w, int h) {
+            return ((ARRANGEMENT & FLIP) ? h - v - 1 : v) * w +
+                ((((ARRANGEMENT & SNAKE) != 0 && v % 2 == 1) != ((ARRANGEMENT & MIRROR) != 0)) ? w - u - 1 : u);
+        }
+
+        static constexpr uint16_t index(int i) {
+            return (ARRANGEMENT & VERTICAL) ? index(i / X_COUNT, i % X_COUNT, Y_COUNT, X_COUNT) :
+                index(i % X_COUNT, i / X_COUNT, X_COUNT, Y_COUNT);
+        }
+    };
+    typedef IndexTable<IndexMap> Table;
+
     CRGB leds[X_COUNT * Y_COUNT];
 
 public:
+    static constexpr int led_count = X_COUNT * Y_COUNT;
     static constexpr int music_bands = X_COUNT;
 
     CRGB *data() override {
@@ -76,24 +156,15 @@ public:
     }
 
     CRGB &at(int x, int y) {
-        int _w = w();
-        int _h = h();
-        if (ARRANGEMENT & VERTICAL) {
-            std::swap(x, y);
-            std::swap(_w, _h);
-        }
-        if (ARRANGEMENT & SNAKE) {
-            if (y % 2 == 1) {
-                x = _w - x - 1;
-            }
-        }
-        if (ARRANGEMENT & MIRROR) {
-            x = _w - x - 1;
-        }
-        if (ARRANGEMENT & FLIP) {
-            y = _h - y - 1;
-        }
-        return leds[y * _w + x];
+        return leds[pgm_read_word(Table::data + y * X_COUNT + x)];
+    }
+
+    PixelRange row(int y) {
+        return PixelRange(leds, Table::data, y * X_COUNT, 1, X_COUNT);
+    }
+
+    PixelRange column(int x) {
+        return PixelRange(leds, Table::data, x, X_COUNT, Y_COUNT);
     }
 };
 
@@ -109,11 +180,23 @@ class LightDisc : public Light {
 private:
     static constexpr int led_ring_count = sizeof...(COUNT_PER_RING);
     static constexpr int led_rings[led_ring_count] = {COUNT_PER_RING...};
-    static constexpr int led_count = sum(led_rings, led_rings + led_ring_count, 0);
     const int rings[led_ring_count] = {COUNT_PER_RING...};
-    CRGB leds[led_count];
+
+    // 每圈第一个灯珠的下标
+    struct IndexMap {
+        static constexpr int size = led_ring_count;
+
+        static constexpr uint16_t index(int ring) {
+            return (ARRANGEMENT & INSIDE_OUT) ? sum(led_rings + ring + 1, led_rings + led_ring_count, 0) :
+                sum(led_rings, led_rings + ring, 0);
+        }
+    };
+    typedef IndexTable<IndexMap> Table;
+
+    CRGB leds[sum(led_rings, led_rings + led_ring_count, 0)];
 
 public:
+    static constexpr int led_count = sum(led_rings, led_rings + led_ring_count, 0);
     static constexpr int music_bands = 1;
 
     CRGB *data() override {
@@ -136,11 +219,15 @@ public:
         if (ARRANGEMENT & ANTICLOCKWISE) {
             i = l(ring) - i - 1;
         }
-        if (ARRANGEMENT & INSIDE_OUT) {
-            return leds[sum(rings + ring + 1, rings + r(), i)];
-        } else {
-            return leds[sum(rings, rings + ring, i)];
+        return leds[pgm_read_word(Table::data + ring) + i];
+    }
+
+    PixelRange ring(int index) {
+        int start = pgm_read_word(Table::data + index);
+        if (ARRANGEMENT & ANTICLOCKWISE) {
+            return PixelRange(leds, nullptr, start + l(index) - 1, -1, l(index));
         }
+        return PixelRange(leds, nullptr, start, 1, l(index));
     }
 };
 
@@ -150,6 +237,7 @@ private:
     CRGB leds[X_COUNT * Y_COUNT * Z_COUNT];
 
 public:
+    static constexpr int led_count = X_COUNT * Y_COUNT * Z_COUNT;
     static constexpr int music_bands = X_COUNT * Y_COUNT;
 
     CRGB *data() override {
@@ -175,6 +263,20 @@ public:
     CRGB &at(int x, int y, int z) {
         return leds[z * l() * w() + y * l() + x];
     }
+
+    // 沿 x 轴的一行
+    PixelRange row(int y, int z) {
+        return PixelRange(leds, nullptr, z * l() * w() + y * l(), 1, l());
+    }
+
+    // 沿 z 轴的一列
+    PixelRange column(int x, int y) {
+        return PixelRange(leds, nullptr, y * l() + x, l() * w(), h());
+    }
+
+    PixelRange layer(int z) {
+        return PixelRange(leds, nullptr, z * l() * w(), 1, l() * w());
+    }
 };
 
 #endif // __LIGHT_HPP__
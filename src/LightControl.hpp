@@ -0,0 +1,476 @@
+#ifndef __LIGHTCONTROL_HPP__
+#define __LIGHTCONTROL_HPP__
+
+#include <atomic>
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "config.h"
+#include "ColorPipeline.hpp"
+#include "CommandHandler.hpp"
+#include "EffectHolder.hpp"
+#include "FrameClock.hpp"
+#include "LatencyTracker.hpp"
+#include "Light.hpp"
+#include "LightEffect.hpp"
+#include "Microphone.hpp"
+#include "RealtimeReceiver.hpp"
+#include "SerialReceiver.hpp"
+#include "utils.h"
+
+/**
+ * 设备和主机模拟器共用的刷新调度和命令处理
+ *
+ * 此文件定义了灯光相关的全局对象, 只能由程序的主文件包含. 包含它的程序还需要实现:
+ * - showLight(): 把 light 中的当前帧经过颜色处理后交给输出, 在渲染端调用
+ * - signalLight(): 让渲染端尽快调用一次 updateLight, 在命令端调用
+ * - settingsChanged(change): 命令改变了需要保存的设置, change 为 StateChange 的组合
+ */
+
+// 灯光相关的设置, 设备上与其他设置一起保存在 config.json 中
+struct LightConfig {
+    uint16_t refreshRate; // 刷新率, 默认 60Hz
+    uint8_t brightness;   // 亮度, 默认 63
+    uint32_t temperature; // 色温, 默认 6600K
+};
+
+// 命令改变的设置, 设备在 loop 中合并后以 "STATE,{...}" 推送, 字段与 config 命令相同
+enum StateChange : uint8_t {
+    CHANGE_NAME = 0x01,
+    CHANGE_MODE = 0x02,
+    CHANGE_BRIGHTNESS = 0x04,
+    CHANGE_TEMPERATURE = 0x08,
+    CHANGE_REFRESH_RATE = 0x10,
+};
+
+// 刷新状态, 仅渲染端修改, 等待或空闲时有新的输入需要立即唤醒
+enum LightState {
+    LIGHT_RUNNING, // 每帧刷新
+    LIGHT_WAITING, // 灯效在一段时间内没有变化, 跳过中间的帧
+    LIGHT_IDLE,    // 灯效静止, 渲染端不再定时
+};
+
+FrameClock frameClock;
+LIGHT_TYPE light;
+EffectHolder<LIGHT_TYPE> lightEffect;
+ColorPipeline colorPipeline;
+volatile bool forceShow; // 亮度等输出参数改变后需要重新输出当前帧
+volatile LightState lightState;
+// 时钟和刷新状态只由渲染端修改, 命令端只增加请求计数再通知渲染端, 渲染端每次运行时对比计数处理新的请求.
+// 计数都只有命令端写入, 不需要原子的读改写, 渲染端停止定时前会再检查一次, 所以请求不会丢失
+std::atomic<uint32_t> wakeRequests;  // 有新的输入或输出参数改变
+std::atomic<uint32_t> clockRequests; // 刷新率改变, 需要重新开始计时
+std::atomic<uint16_t> frameRate(60); // 最近一次请求的刷新率, 命令端用它代替 frameClock
+#ifdef ENABLE_REALTIME
+RealtimeReceiver<LIGHT_TYPE> realtime;
+SerialReceiver<LIGHT_TYPE> serialReceiver(Serial, realtime);
+#else
+SerialReceiver<LIGHT_TYPE> serialReceiver(Serial);
+#endif
+#ifdef ENABLE_LATENCY_TRACE
+LatencyTracker latency;
+#endif
+#ifdef ENABLE_MICROPHONE
+Microphone<LIGHT_TYPE::music_bands> microphone;
+uint32_t lastMusicInput = -MIC_HOLDOFF_MS; // 上一次收到网页端音量的时间
+#endif
+int8_t commandClient = -1; // 正在处理的命令来自哪个 WebSocket 客户端, 串口和 HTTP 为 -1
+
+void showLight();
+void signalLight();
+void settingsChanged(uint8_t change);
+
+/**
+ * @brief Handle the requests from the command side and render a frame if one is due, only for the render side
+ *
+ * @return uint32_t microseconds until it should be called again, NO_UPDATE if idle until signaled
+ */
+uint32_t updateLight() {
+    static uint32_t handledWakes = 0;
+    static uint32_t handledClocks = 0;
+    uint32_t clocks = clockRequests.load(std::memory_order_acquire);
+    if (clocks != handledClocks) {
+        handledClocks = clocks;
+        frameClock.start(frameRate.load(std::memory_order_relaxed), micros());
+        lightState = LIGHT_RUNNING;
+    }
+    uint32_t wakes = wakeRequests.load(std::memory_order_acquire);
+    if (wakes != handledWakes) {
+        handledWakes = wakes;
+        if (lightState != LIGHT_RUNNING) {
+            lightState = LIGHT_RUNNING;
+            frameClock.resume(micros());
+        }
+    }
+    uint32_t deltaTime;
+    if (lightState != LIGHT_IDLE && frameClock.tick(micros(), deltaTime)) {
+#ifdef ENABLE_LATENCY_TRACE
+        latency.beginFrame();
+#endif
+        Effect *effect = lightEffect.acquire();
+#ifdef ENABLE_REALTIME
+        bool live = realtime.isActive(); // 实时输入时暂停灯效, 收到新的一帧时再唤醒
+        bool updated = live ? realtime.update(light) : Effect::dispatchUpdate(effect, light, deltaTime);
+#else
+        bool updated = Effect::dispatchUpdate(effect, light, deltaTime);
+#endif
+        if (updated || forceShow) {
+            forceShow = false;
+            showLight();
+        }
+        // 灯效没有变化时跳过中间的帧, 静止时停止定时, 等待 wakeLight 唤醒
+#ifdef ENABLE_REALTIME
+        uint32_t wait = forceShow ? 0 : live ? NO_UPDATE : Effect::dispatchNextUpdate<LIGHT_TYPE>(effect);
+#else
+        uint32_t wait = forceShow ? 0 : Effect::dispatchNextUpdate<LIGHT_TYPE>(effect);
+#endif
+        lightEffect.release();
+        // 停止前再检查一次, 渲染这一帧时到达的输入在下一帧显示
+        if (wait == NO_UPDATE && wakeRequests.load(std::memory_order_acquire) != handledWakes) {
+            wait = 0;
+        }
+        if (wait == NO_UPDATE) {
+            lightState = LIGHT_IDLE;
+        } else {
+            frameClock.idle(std::min<uint32_t>(wait, 1000000));
+            lightState = wait > 0 ? LIGHT_WAITING : LIGHT_RUNNING;
+        }
+    }
+    return lightState == LIGHT_IDLE ? NO_UPDATE : frameClock.untilNextFrame(micros());
+}
+
+// 以新的刷新率重新开始计时, 仅命令端调用
+void startFrameClock(uint16_t refreshRate) {
+    // 刷新率不能超过数据线传完一帧所需的时间
+    frameRate.store(std::min(refreshRate, FrameClock::maxFrameRate(light.count())), std::memory_order_relaxed);
+    clockRequests.store(clockRequests.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    signalLight();
+}
+
+// 灯效有新的输入或输出参数改变后立即刷新一帧, 仅命令端调用
+void wakeLight() {
+    wakeRequests.store(wakeRequests.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    signalLight();
+}
+
+// 在 loop 中提前读取动画的后续帧, 渲染回调中不读文件
+void handleAnimation() {
+    if (lightEffect->type() == ANIMATION) {
+        if (((AnimationEffect<LIGHT_TYPE> *) lightEffect.get())->prefetch()) {
+            wakeLight();
+        }
+    }
+}
+
+#ifdef ENABLE_REALTIME
+// 收到新的实时帧时唤醒刷新, 超时后 light 中还是实时数据, 所以重新开始原来的灯效
+void handleRealtime() {
+    bool live = realtime.isActive();
+#ifdef ENABLE_LATENCY_TRACE
+    uint32_t start = micros();
+#endif
+    if (realtime.poll()) {
+#ifdef ENABLE_LATENCY_TRACE
+        latency.received(LATENCY_REALTIME, start);
+#endif
+        wakeLight();
+    }
+    if (live && !realtime.isActive()) {
+        StaticJsonDocument<512> doc;
+        lightEffect->writeToJSON(doc);
+        lightEffect.publish(Effect::readFromJSON<LIGHT_TYPE>(lightEffect.allocate(), doc));
+        wakeLight();
+    }
+}
+#endif
+
+#ifdef ENABLE_MICROPHONE
+// 音乐律动模式下用麦克风的音量驱动灯效, 网页端在发送音量时优先使用网页端的
+void handleMicrophone() {
+    if (lightEffect->type() != MUSIC || millis() - lastMusicInput < MIC_HOLDOFF_MS) {
+        return;
+    }
+#ifdef ENABLE_LATENCY_TRACE
+    uint32_t start = micros();
+#endif
+    uint16_t volumes[LIGHT_TYPE::music_bands];
+    if (microphone.poll(volumes)) {
+        ((MusicEffect<LIGHT_TYPE> *) lightEffect.get())->setVolumes(volumes);
+#ifdef ENABLE_LATENCY_TRACE
+        latency.received(LATENCY_MUSIC, start);
+#endif
+        wakeLight();
+    }
+}
+#endif
+
+/**
+ * @brief Handle the data received from Serial, Adalight/TPM2 frames go to realtime input
+ *
+ * @return char* a complete command line, nullptr if there is none yet
+ */
+char* pollSerial() {
+#ifdef ENABLE_LATENCY_TRACE
+    uint32_t start = micros();
+#endif
+    if (serialReceiver.poll()) {
+#ifdef ENABLE_LATENCY_TRACE
+        latency.received(LATENCY_REALTIME, start);
+#endif
+        wakeLight();
+    }
+    return serialReceiver.getLine();
+}
+
+// 实时输入比刷新快时, 来不及显示的数据会被新数据替换, 提醒发送端把间隔调大到至少一帧, 每秒最多提醒一次
+void checkDropped(SenderFunc sender, uint32_t dropped) {
+    static uint32_t lastDropped = 0;
+    static uint32_t lastNotifyTime = -1000; // 开机后的第一秒也能提醒
+    if (dropped == lastDropped) {
+        return;
+    }
+    lastDropped = dropped;
+    if (millis() - lastNotifyTime < 1000) {
+        return;
+    }
+    lastNotifyTime = millis();
+    uint16_t rate = frameRate.load(std::memory_order_relaxed);
+    String str = "THROTTLE," + String((1000 + rate - 1) / rate);
+    sender(str.c_str());
+}
+
+void executeCommand(SenderFunc sender, char *line) {
+    if (lightEffect->type() == MUSIC) {
+        if (!isalpha(line[0])) { // 假定所有命令都是字母开头且以字母开头的一定是命令
+            float volumes[LIGHT_TYPE::music_bands];
+            int count = 0;
+            char *p = line;
+            while (count < LIGHT_TYPE::music_bands) {
+                char *q = strchr(p, ',');
+                if (q) {
+                    *q = '\0';
+                }
+                volumes[count++] = atof(p);
+                if (!q) break;
+                p = q + 1;
+            }
+            MusicEffect<LIGHT_TYPE> *effect = (MusicEffect<LIGHT_TYPE> *) lightEffect.get();
+            effect->setVolumes(volumes, count);
+#ifdef ENABLE_MICROPHONE
+            lastMusicInput = millis();
+#endif
+            wakeLight();
+            checkDropped(sender, effect->getDropped());
+            return;
+        }
+    } else if (lightEffect->type() == CUSTOM) {
+        if (!isalpha(line[0])) {
+            // 整行的颜色写完后只发布一帧, 避免逐个像素发布把帧挤掉
+            CustomEffect<LIGHT_TYPE> *effect = (CustomEffect<LIGHT_TYPE> *) lightEffect.get();
+            for (char *color = strtok(line, ", \t\r\n"); color; color = strtok(NULL, ", \t\r\n")) {
+                effect->writePixel(CRGB(str2hex(color)));
+            }
+            if (effect->commitPixels()) {
+                wakeLight();
+            }
+            return;
+        }
+    }
+    cmdHandler.parseCommand(sender, line);
+}
+
+// 以 "@N," 开头的命令改变灯光后, 在显示出来时回复 "SHOWN,N,...", 格式见 LatencyTracker
+void handleCommand(SenderFunc sender, char *line) {
+#ifdef ENABLE_LATENCY_TRACE
+    uint32_t start = micros();
+    uint32_t tag = 0;
+    int8_t client = LatencyTracker::NO_REPLY;
+    if (line[0] == '@') {
+        char *end;
+        tag = strtoul(line + 1, &end, 10);
+        line = *end == ',' ? end + 1 : end;
+        client = commandClient >= 0 ? commandClient : LatencyTracker::SERIAL_REPLY;
+    }
+    LatencyStream stream = isalpha(line[0]) ? LATENCY_COMMAND :
+        lightEffect->type() == MUSIC ? LATENCY_MUSIC : lightEffect->type() == CUSTOM ? LATENCY_CUSTOM : LATENCY_COMMAND;
+    uint32_t wakes = wakeRequests.load(std::memory_order_relaxed);
+    executeCommand(sender, line);
+    if (wakeRequests.load(std::memory_order_relaxed) != wakes) { // 命令改变了灯光
+        latency.received(stream, start, tag, client);
+    }
+#else
+    executeCommand(sender, line);
+#endif
+}
+
+// 自定义灯效的二进制帧和音乐律动的音量, 格式见 CustomEffect 和 MusicEffect
+void handleBinary(SenderFunc sender, uint8_t *data, size_t length) {
+#ifdef ENABLE_LATENCY_TRACE
+    uint32_t start = micros();
+    uint32_t tag = 0;
+    int8_t client = LatencyTracker::NO_REPLY;
+    if (length >= 5 && data[0] == '@') { // '@' 加 4 字节小端序号, 之后是原来的消息
+        tag = data[1] | data[2] << 8 | data[3] << 16 | (uint32_t) data[4] << 24;
+        client = commandClient >= 0 ? commandClient : LatencyTracker::SERIAL_REPLY;
+        data += 5;
+        length -= 5;
+    }
+#endif
+    bool valid = false;
+    uint32_t dropped = 0;
+    if (lightEffect->type() == CUSTOM) {
+        valid = ((CustomEffect<LIGHT_TYPE> *) lightEffect.get())->writeFrame(data, length);
+        dropped = CustomEffect<LIGHT_TYPE>::getDropped();
+    } else if (lightEffect->type() == MUSIC) {
+        MusicEffect<LIGHT_TYPE> *effect = (MusicEffect<LIGHT_TYPE> *) lightEffect.get();
+        valid = effect->setVolumes(data, length);
+        dropped = effect->getDropped();
+#ifdef ENABLE_MICROPHONE
+        lastMusicInput = millis();
+#endif
+    }
+    if (valid) {
+#ifdef ENABLE_LATENCY_TRACE
+        latency.received(lightEffect->type() == MUSIC ? LATENCY_MUSIC : LATENCY_CUSTOM, start, tag, client);
+#endif
+        wakeLight();
+        checkDropped(sender, dropped);
+    } else {
+        sender("INVAILD"); // 成功时不回复, 避免每帧都多一条消息
+    }
+}
+
+// status 命令中与灯光相关的部分
+void writeLightStatus(JsonDocument &doc) {
+    doc["fps"] = frameRate.load(std::memory_order_relaxed);
+    doc["skippedFrames"] = frameClock.getSkippedFrames();
+    doc["current"] = colorPipeline.getCurrent();
+    // 来不及显示就被新数据替换的实时输入数
+    JsonObject dropped = doc.createNestedObject("dropped");
+    if (lightEffect->type() == MUSIC) {
+        doc["bpm"] = ((MusicEffect<LIGHT_TYPE> *) lightEffect.get())->getBPM();
+        dropped["music"] = ((MusicEffect<LIGHT_TYPE> *) lightEffect.get())->getDropped();
+    } else if (lightEffect->type() == ANIMATION) {
+        // 播放时还没有预读好而跳过的动画帧数
+        doc["animUnderruns"] = ((AnimationEffect<LIGHT_TYPE> *) lightEffect.get())->getUnderruns();
+    }
+    dropped["custom"] = CustomEffect<LIGHT_TYPE>::getDropped();
+#ifdef ENABLE_REALTIME
+    doc["realtime"] = realtime.isActive();
+    dropped["realtime"] = realtime.getDropped();
+#endif
+}
+
+/**
+ * @brief Register the commands that control the light
+ *
+ * @param config settings changed by the commands, must outlive the command handler
+ */
+void registerLightCommands(LightConfig &config) {
+    cmdHandler.setDefaultHandler([](SenderFunc sender, int argc, char *argv[]) {
+        sender("Unknown command. type 'help' for helps.");
+    });
+    cmdHandler.registerCommand("help", "Show command helps", [](SenderFunc sender, int argc, char *argv[]) {
+        cmdHandler.printHelp(sender);
+    });
+#ifdef ENABLE_LATENCY_TRACE
+    cmdHandler.registerCommand("latency", "Show latency of inputs: [stream|reset]", [](SenderFunc sender, int argc, char *argv[]) {
+        if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+            latency.reset();
+            sender("OK");
+            return;
+        }
+        int stream = argc > 1 ? LatencyTracker::findStream(argv[1]) : -1;
+        if (argc > 1 && stream < 0) {
+            sender("INVAILD");
+            return;
+        }
+        DynamicJsonDocument doc(1536);
+        doc.to<JsonObject>(); // 没有记录时也输出 {}
+        latency.writeToJSON(doc, stream);
+        String str;
+        serializeJson(doc, str);
+        sender(str.c_str());
+    });
+#endif
+    cmdHandler.registerCommand("mode", "Get/set light mode", [](SenderFunc sender, int argc, char *argv[]) {
+        if (argc <= 1) {
+            String str = effect2str(lightEffect->type());
+            sender(str.c_str());
+            return;
+        }
+        EffectType type = str2effect(argv[1]);
+        if (type >= CONSTANT && type < EFFECT_TYPE_COUNT) {
+            lightEffect.publish(Effect::readFromArgs<LIGHT_TYPE>(lightEffect.allocate(), type, argc - 2, (const char **) argv + 2));
+            wakeLight();
+            settingsChanged(CHANGE_MODE);
+            sender("OK");
+        } else {
+            sender("INVAILD");
+        }
+    });
+    cmdHandler.registerCommand("bands", "Get music band count", [](SenderFunc sender, int argc, char *argv[]) {
+        String str = String(LIGHT_TYPE::music_bands);
+        sender(str.c_str());
+    });
+    cmdHandler.registerCommand("brightness", "Get/set brightness", [&config](SenderFunc sender, int argc, char *argv[]) {
+        if (argc <= 1) {
+            String str = String(config.brightness);
+            sender(str.c_str());
+            return;
+        }
+        int brightness = atoi(argv[1]);
+        if (brightness >= 0 && brightness <= 255) {
+            if (config.brightness != brightness) {
+                colorPipeline.setBrightness(brightness);
+                forceShow = true;
+                wakeLight();
+                config.brightness = (uint8_t) brightness;
+                settingsChanged(CHANGE_BRIGHTNESS);
+            }
+            sender("OK");
+        } else {
+            sender("INVAILD");
+        }
+    });
+    cmdHandler.registerCommand("temperature", "Get/set temperature", [&config](SenderFunc sender, int argc, char *argv[]) {
+        if (argc <= 1) {
+            String str = String(config.temperature) + String('K');
+            sender(str.c_str());
+            return;
+        }
+        int temperature = atoi(argv[1]);
+        if (temperature >= 0) {
+            if (config.temperature != (uint32_t) temperature) {
+                colorPipeline.setTemperature(temperature);
+                forceShow = true;
+                wakeLight();
+                config.temperature = (uint32_t) temperature;
+                settingsChanged(CHANGE_TEMPERATURE);
+            }
+            sender("OK");
+        } else {
+            sender("INVAILD");
+        }
+    });
+    cmdHandler.registerCommand("fps", "Get/set refresh rate", [&config](SenderFunc sender, int argc, char *argv[]) {
+        if (argc <= 1) {
+            String str = String(config.refreshRate);
+            sender(str.c_str());
+            return;
+        }
+        int rate = atoi(argv[1]);
+        if (rate > 0 && rate <= 400) {
+            if (config.refreshRate != rate) {
+                config.refreshRate = (uint16_t) rate;
+                startFrameClock(config.refreshRate);
+                settingsChanged(CHANGE_REFRESH_RATE);
+            }
+            sender("OK");
+        } else {
+            sender("INVAILD");
+        }
+    });
+}
+
+#endif // __LIGHTCONTROL_HPP__
@@ -1,11 +1,17 @@
 #ifndef __LIGHTEFFECT_HPP__
 #define __LIGHTEFFECT_HPP__
 
+#include <atomic>
+#include <new>
 #include <Arduino.h>
 #include <LittleFS.h>
 #include <FastLED.h>
 #include <ArduinoJson.h>
 
+#include "AnimationFile.hpp"
+#include "AnimationPartition.hpp"
+#include "BeatDetector.hpp"
+#include "FrameBuffer.hpp"
 #include "Light.hpp"
 #include "utils.h"
 
@@ -38,30 +44,77 @@ EffectType str2effect(const char *str);
  */
 const char* effect2str(EffectType effect);
 
-extern const uint16_t &fps;
+// 旧版灯效的参数以帧为单位, 以此刷新率为基准换算为时间
+#define REFERENCE_FRAME_RATE 60
+// 灯效不需要定时更新, 直到有新的输入
+#define NO_UPDATE UINT32_MAX
 
+/**
+ * 把经过的时间换算为固定帧率下的帧数, 不足一帧的部分累积到下次
+ */
+class FrameCounter {
+private:
+    uint32_t remainder;
+
+public:
+    FrameCounter() : remainder(0) {}
+
+    uint32_t advance(uint32_t deltaTime, uint16_t frameRate = REFERENCE_FRAME_RATE) {
+        uint64_t time = (uint64_t) deltaTime * frameRate + remainder;
+        remainder = time % 1000000;
+        return time / 1000000;
+    }
+
+    uint32_t untilNext(uint16_t frameRate = REFERENCE_FRAME_RATE) {
+        return (1000000 - remainder + frameRate - 1) / frameRate;
+    }
+};
+
+/**
+ * 灯效基类
+ *
+ * 灯效由工厂函数构造在 EffectHolder 提供的固定大小的位置上, 不使用堆内存;
+ * 渲染时通过 dispatchUpdate 按类型直接调用具体灯效, 新增灯效时需要同时加入下面的各个 switch 和 EffectStorage
+ */
 class Effect {
+private:
+    EffectType effectType;
+
+protected:
+    Effect(EffectType type) : effectType(type) {}
+
 public:
-    virtual EffectType type() = 0;
+    virtual ~Effect() {}
+    EffectType type() {
+        return effectType;
+    }
     virtual bool update(Light &light, uint32_t deltaTime) = 0;
+    /**
+     * @brief Get the time until the effect needs to be updated again, called after update
+     *
+     * @return uint32_t microseconds since the last update, 0 for the next frame, NO_UPDATE to wait for new input
+     */
+    virtual uint32_t nextUpdate() { return 0; }
     virtual void writeToJSON(JsonDocument &json) { json["mode"] = type(); };
     template <typename LIGHT>
-    static Effect* readFromJSON(JsonDocument &json);
+    static Effect* readFromJSON(void *slot, JsonDocument &json);
+    template <typename LIGHT>
+    static Effect* readFromArgs(void *slot, EffectType type, int argc, const char *argv[]);
+    template <typename LIGHT>
+    static bool dispatchUpdate(Effect *effect, LIGHT &light, uint32_t deltaTime);
+    template <typename LIGHT>
+    static uint32_t dispatchNextUpdate(Effect *effect);
 };
 
 template <typename LIGHT>
-class ConstantEffect : public Effect {
+class ConstantEffect final : public Effect {
 private:
     bool updated;
     CRGB currentColor;
 
 public:
     ConstantEffect(uint32_t color) :
-        updated(false), currentColor(color) {}
-
-    EffectType type() override {
-        return CONSTANT;
-    }
+        Effect(CONSTANT), updated(false), currentColor(color) {}
 
     bool update(Light &light, uint32_t deltaTime) override {
         if (!updated) {
@@ -72,48 +125,61 @@ public:
         return false;
     }
 
+    uint32_t nextUpdate() override {
+        return updated ? NO_UPDATE : 0;
+    }
+
     void writeToJSON(JsonDocument &json) override {
         Effect::writeToJSON(json);
         json["color"] = rgb2hex(currentColor.r, currentColor.g, currentColor.b);
     }
 
-    static ConstantEffect* readFromJSON(JsonDocument &json) {
+    static ConstantEffect* readFromJSON(void *slot, JsonDocument &json) {
         uint32_t color = json["color"];
-        return new ConstantEffect(color);
+        return new (slot) ConstantEffect(color);
+    }
+
+    static ConstantEffect* readFromArgs(void *slot, int argc, const char *argv[]) {
+        uint32_t color = argc > 0 ? str2hex(argv[0]) : DEFAULT_COLOR;
+        return new (slot) ConstantEffect(color);
     }
 };
 
 template <typename LIGHT>
-class BlinkEffect : public Effect {
+class BlinkEffect final : public Effect {
 private:
-    uint16_t currentFrame;
+    uint32_t currentTime;
+    int8_t lit; // -1 表示尚未渲染
     CRGB currentColor;
     float lastTime;
     float interval;
 
 public:
     BlinkEffect(uint32_t color, float lastTime, float interval) :
-        currentFrame(0), currentColor(color), lastTime(lastTime), interval(interval) {}
-
-    EffectType type() override {
-        return BLINK;
-    }
+        Effect(BLINK), currentTime(0), lit(-1), currentColor(color), lastTime(lastTime), interval(interval) {}
 
     bool update(Light &light, uint32_t deltaTime) override {
-        int lastTime = fps * this->lastTime;
-        int interval = fps * this->interval;
-        bool needUpdate = false;
-        if (currentFrame == 0) {
-            fill_solid(light.data(), light.count(), currentColor);
-            needUpdate = true;
-        } else if (currentFrame == lastTime) {
-            fill_solid(light.data(), light.count(), CRGB::Black);
-            needUpdate = true;
+        uint32_t lastTime = this->lastTime * 1000000;
+        uint32_t interval = this->interval * 1000000;
+        if (lastTime + interval > 0) {
+            currentTime = (currentTime + deltaTime) % (lastTime + interval);
         }
-        if (++currentFrame >= lastTime + interval) {
-            currentFrame = 0;
+        int8_t on = currentTime < lastTime || interval == 0;
+        if (on == lit) {
+            return false;
         }
-        return needUpdate;
+        fill_solid(light.data(), light.count(), on ? currentColor : CRGB(CRGB::Black));
+        lit = on;
+        return true;
+    }
+
+    uint32_t nextUpdate() override {
+        uint32_t lastTime = this->lastTime * 1000000;
+        uint32_t interval = this->interval * 1000000;
+        if (lastTime == 0 || interval == 0) { // 常亮或常灭
+            return lit < 0 ? 0 : NO_UPDATE;
+        }
+        return (lit ? lastTime : lastTime + interval) - currentTime;
     }
 
     void writeToJSON(JsonDocument &json) override {
@@ -123,46 +189,64 @@ public:
         json["interval"] = interval;
     }
 
-    static BlinkEffect* readFromJSON(JsonDocument &json) {
+    static BlinkEffect* readFromJSON(void *slot, JsonDocument &json) {
         uint32_t color = json["color"];
         float lastTime = json["lastTime"];
         float interval = json["interval"];
-        return new BlinkEffect(color, lastTime, interval);
+        return new (slot) BlinkEffect(color, lastTime, interval);
+    }
+
+    static BlinkEffect* readFromArgs(void *slot, int argc, const char *argv[]) {
+        uint32_t color = argc > 0 ? str2hex(argv[0]) : DEFAULT_COLOR;
+        float lastTime = argc > 1 ? atof(argv[1]) : 1.0;
+        float interval = argc > 2 ? atof(argv[2]) : 1.0;
+        return new (slot) BlinkEffect(color, lastTime, interval);
     }
 };
 
 template <typename LIGHT>
-class BreathEffect : public Effect {
+class BreathEffect final : public Effect {
 private:
-    uint16_t currentFrame;
+    uint32_t currentTime;
+    bool dark;
     CRGB currentColor;
     float lastTime;
     float interval;
 
 public:
     BreathEffect(uint32_t color, float lastTime, float interval) :
-        currentFrame(0), currentColor(color), lastTime(lastTime), interval(interval) {}
-
-    EffectType type() override {
-        return BREATH;
-    }
+        Effect(BREATH), currentTime(0), dark(false), currentColor(color), lastTime(lastTime), interval(interval) {}
 
     bool update(Light &light, uint32_t deltaTime) override {
-        int lastTime = fps * this->lastTime;
-        int interval = fps * this->interval;
-        bool needUpdate = false;
-        if (currentFrame <= lastTime) {
+        uint32_t lastTime = this->lastTime * 1000000;
+        uint32_t interval = this->interval * 1000000;
+        if (lastTime + interval > 0) {
+            currentTime = (currentTime + deltaTime) % (lastTime + interval);
+        }
+        if (currentTime < lastTime) {
             CRGB rgb = currentColor;
-            double x = (double) currentFrame / lastTime;
+            float x = (float) currentTime / lastTime;
             int scale = -1010 * x * x + 1010 * x;
             rgb.nscale8(scale);
             fill_solid(light.data(), light.count(), rgb);
-            needUpdate = true;
+            dark = false;
+            return true;
         }
-        if (++currentFrame >= lastTime + interval) {
-            currentFrame = 0;
+        if (!dark) { // 间隔期间只需熄灭一次
+            fill_solid(light.data(), light.count(), CRGB::Black);
+            dark = true;
+            return true;
+        }
+        return false;
+    }
+
+    uint32_t nextUpdate() override {
+        uint32_t lastTime = this->lastTime * 1000000;
+        uint32_t interval = this->interval * 1000000;
+        if (currentTime < lastTime) {
+            return 0;
         }
-        return needUpdate;
+        return interval > 0 ? lastTime + interval - currentTime : NO_UPDATE;
     }
 
     void writeToJSON(JsonDocument &json) override {
@@ -172,96 +256,109 @@ public:
         json["interval"] = interval;
     }
 
-    static BreathEffect* readFromJSON(JsonDocument &json) {
+    static BreathEffect* readFromJSON(void *slot, JsonDocument &json) {
         uint32_t color = json["color"];
         float lastTime = json["lastTime"];
         float interval = json["interval"];
-        return new BreathEffect(color, lastTime, interval);
+        return new (slot) BreathEffect(color, lastTime, interval);
+    }
+
+    static BreathEffect* readFromArgs(void *slot, int argc, const char *argv[]) {
+        uint32_t color = argc > 0 ? str2hex(argv[0]) : DEFAULT_COLOR;
+        float lastTime = argc > 1 ? atof(argv[1]) : 1.0;
+        float interval = argc > 2 ? atof(argv[2]) : 0.5;
+        return new (slot) BreathEffect(color, lastTime, interval);
     }
 };
 
 template <typename LIGHT>
-class ChaseEffect : public Effect {
+class ChaseEffect final : public Effect {
 private:
-    uint16_t currentFrame;
+    uint32_t currentTime;
+    int currentIndex;
     CRGB currentColor;
     uint8_t direction;
     float lastTime;
 
+    /**
+     * @brief Advance the chase, it goes forth and back over count positions
+     *
+     * @param deltaTime time elapsed since last frame in microseconds
+     * @param count number of positions
+     * @return int position to light up, -1 if unchanged
+     */
+    int step(uint32_t deltaTime, int count) {
+        uint32_t lastTime = std::max<uint32_t>(this->lastTime * 1000000, 1);
+        currentTime = (currentTime + deltaTime) % ((uint64_t) lastTime * count * 2);
+        int index = currentTime / lastTime;
+        if (index == currentIndex) {
+            return -1;
+        }
+        currentIndex = index;
+        return index > count - 1 ? count * 2 - 1 - index : index;
+    }
+
 public:
     ChaseEffect(uint32_t color, uint8_t direction, float lastTime) :
-        currentFrame(0), currentColor(color), direction(direction), lastTime(lastTime) {}
-
-    EffectType type() override {
-        return CHASE;
-    }
+        Effect(CHASE), currentTime(0), currentIndex(-1), currentColor(color), direction(direction), lastTime(lastTime) {}
 
     bool update(Light &light, uint32_t deltaTime) override {
         return update(static_cast<LIGHT&>(light), deltaTime);
     }
 
+    uint32_t nextUpdate() override {
+        uint32_t lastTime = std::max<uint32_t>(this->lastTime * 1000000, 1);
+        return (uint64_t) lastTime * (currentIndex + 1) - currentTime;
+    }
+
     template <int COUNT, bool REVERSE>
     bool update(LightStrip<COUNT, REVERSE> &light, uint32_t deltaTime) {
-        int lastTime = fps * this->lastTime;
-        bool needUpdate = false;
-        if (currentFrame % lastTime == 0) {
-            fill_solid(light.data(), light.count(), CRGB::Black);
-            int index = currentFrame / lastTime;
-            if (index > light.l() * 2 - 1) {
-                currentFrame = 0;
-                index = 0;
-            } else if (index > light.l() - 1) {
-                index = light.l() * 2 - 1 - index;
-            }
-            light.at(index) = currentColor;
-            needUpdate = true;
+        int index = step(deltaTime, light.l());
+        if (index < 0) {
+            return false;
         }
-        ++currentFrame;
-        return needUpdate;
+        fill_solid(light.data(), light.count(), CRGB::Black);
+        light.at(index) = currentColor;
+        return true;
     }
 
     template <int X_COUNT, int Y_COUNT, int ARRANGEMENT>
     bool update(LightPanel<X_COUNT, Y_COUNT, ARRANGEMENT> &light, uint32_t deltaTime) {
-        int lastTime = fps * this->lastTime;
-        bool needUpdate = false;
-        if (currentFrame % lastTime == 0) {
-            fill_solid(light.data(), light.count(), CRGB::Black);
-            int index = currentFrame / lastTime;
-            if (index > light.h() * 2 - 1) {
-                currentFrame = 0;
-                index = 0;
-            } else if (index > light.h() - 1) {
-                index = light.h() * 2 - 1 - index;
-            }
-            for (int j = 0; j < light.w(); j++) {
-                light.at(j, index) = currentColor;
-            }
-            needUpdate = true;
+        int index = step(deltaTime, light.h());
+        if (index < 0) {
+            return false;
+        }
+        fill_solid(light.data(), light.count(), CRGB::Black);
+        for (CRGB &led : light.row(index)) {
+            led = currentColor;
         }
-        ++currentFrame;
-        return needUpdate;
+        return true;
     }
 
     template <int ARRANGEMENT, int... COUNT_PER_RING>
     bool update(LightDisc<ARRANGEMENT, COUNT_PER_RING...> &light, uint32_t deltaTime) {
-        int lastTime = fps * this->lastTime;
-        bool needUpdate = false;
-        if (currentFrame % lastTime == 0) {
-            fill_solid(light.data(), light.count(), CRGB::Black);
-            int index = currentFrame / lastTime;
-            if (index > light.r() * 2 - 1) {
-                currentFrame = 0;
-                index = 0;
-            } else if (index > light.r() - 1) {
-                index = light.r() * 2 - 1 - index;
-            }
-            for (int j = 0; j < light.l(index); j++) {
-                light.at(index, j) = currentColor;
-            }
-            needUpdate = true;
+        int index = step(deltaTime, light.r());
+        if (index < 0) {
+            return false;
         }
-        ++currentFrame;
-        return needUpdate;
+        fill_solid(light.data(), light.count(), CRGB::Black);
+        for (CRGB &led : light.ring(index)) {
+            led = currentColor;
+        }
+        return true;
+    }
+
+    template <int X_COUNT, int Y_COUNT, int Z_COUNT>
+    bool update(LightCube<X_COUNT, Y_COUNT, Z_COUNT> &light, uint32_t deltaTime) {
+        int index = step(deltaTime, light.h());
+        if (index < 0) {
+            return false;
+        }
+        fill_solid(light.data(), light.count(), CRGB::Black);
+        for (CRGB &led : light.layer(index)) {
+            led = currentColor;
+        }
+        return true;
     }
 
     void writeToJSON(JsonDocument &json) override {
@@ -271,71 +368,97 @@ public:
         json["lastTime"] = lastTime;
     }
 
-    static ChaseEffect* readFromJSON(JsonDocument &json) {
+    static ChaseEffect* readFromJSON(void *slot, JsonDocument &json) {
         uint32_t color = json["color"];
         uint8_t direction = json["direction"];
         float lastTime = json["lastTime"];
-        return new ChaseEffect(color, direction, lastTime);
+        return new (slot) ChaseEffect(color, direction, lastTime);
+    }
+
+    static ChaseEffect* readFromArgs(void *slot, int argc, const char *argv[]) {
+        uint32_t color    = argc > 0 ? str2hex(argv[0]) : DEFAULT_COLOR;
+        uint8_t direction = argc > 1 ? atoi(argv[1]) : 0;
+        float lastTime    = argc > 2 ? atof(argv[2]) : 0.2;
+        return new (slot) ChaseEffect(color, direction, lastTime);
     }
 };
 
 template <typename LIGHT>
-class RainbowEffect : public Effect {
+class RainbowEffect final : public Effect {
 private:
+    FrameCounter frames;
+    bool updated;
     uint8_t currentHue;
     int8_t delta;
 
 public:
     RainbowEffect(int8_t delta) :
-        currentHue(0), delta(delta) {}
-
-    EffectType type() override {
-        return RAINBOW;
-    }
+        Effect(RAINBOW), updated(false), currentHue(0), delta(delta) {}
 
     bool update(Light &light, uint32_t deltaTime) override {
+        uint32_t count = frames.advance(deltaTime);
+        if (updated && (count == 0 || delta == 0)) { // 颜色没有变化
+            return false;
+        }
+        currentHue += delta * count;
         CHSV hsv(currentHue, 255, 240);
         CRGB rgb;
         hsv2rgb_rainbow(hsv, rgb);
         fill_solid(light.data(), light.count(), rgb);
-        currentHue += delta;
+        updated = true;
         return true;
     }
 
+    uint32_t nextUpdate() override {
+        return delta == 0 ? NO_UPDATE : frames.untilNext();
+    }
+
     void writeToJSON(JsonDocument &json) override {
         Effect::writeToJSON(json);
         json["delta"] = delta;
     }
 
-    static RainbowEffect* readFromJSON(JsonDocument &json) {
+    static RainbowEffect* readFromJSON(void *slot, JsonDocument &json) {
         uint8_t delta = json["delta"];
-        return new RainbowEffect(delta);
+        return new (slot) RainbowEffect(delta);
+    }
+
+    static RainbowEffect* readFromArgs(void *slot, int argc, const char *argv[]) {
+        int8_t delta = argc > 0 ? atoi(argv[0]) : 1;
+        return new (slot) RainbowEffect(delta);
     }
 };
 
 template <typename LIGHT>
-class StreamEffect : public Effect {
+class StreamEffect final : public Effect {
 private:
+    FrameCounter frames;
+    bool updated;
     uint8_t currentHue;
     uint8_t direction;
     int8_t delta;
 
 public:
     StreamEffect(uint8_t direction, int8_t delta) :
-        currentHue(0), direction(direction), delta(delta) {}
-
-    EffectType type() override {
-        return STREAM;
-    }
+        Effect(STREAM), updated(false), currentHue(0), direction(direction), delta(delta) {}
 
     bool update(Light &light, uint32_t deltaTime) override {
+        uint32_t count = frames.advance(deltaTime);
+        if (updated && (count == 0 || delta == 0)) { // 颜色没有变化
+            return false;
+        }
+        currentHue += delta * count;
+        updated = true;
         return update(static_cast<LIGHT&>(light), deltaTime);
     }
 
+    uint32_t nextUpdate() override {
+        return delta == 0 ? NO_UPDATE : frames.untilNext();
+    }
+
     template <int COUNT, bool REVERSE>
     bool update(LightStrip<COUNT, REVERSE> &light, uint32_t deltaTime) {
         fill_rainbow(light.data(), light.count(), currentHue);
-        currentHue += delta;
         return true;
     }
 
@@ -343,12 +466,12 @@ public:
     bool update(LightPanel<X_COUNT, Y_COUNT, ARRANGEMENT> &light, uint32_t deltaTime) {
         CRGB rgb[light.w()];
         fill_rainbow(rgb, light.w(), currentHue);
-        for (int i = 0; i < light.h(); i++) {
-            for (int j = 0; j < light.w(); j++) {
-                light.at(j, i) = rgb[j];
+        for (int y = 0; y < light.h(); y++) {
+            PixelRange row = light.row(y);
+            for (int x = 0; x < row.size(); x++) {
+                row[x] = rgb[x];
             }
         }
-        currentHue += delta;
         return true;
     }
 
@@ -357,11 +480,22 @@ public:
         CRGB rgb[light.r()];
         fill_rainbow(rgb, light.r(), currentHue);
         for (int i = 0; i < light.r(); i++) {
-            for (int j = 0; j < light.l(i); j++) {
-                light.at(i, j) = rgb[i];
+            for (CRGB &led : light.ring(i)) {
+                led = rgb[i];
+            }
+        }
+        return true;
+    }
+
+    template <int X_COUNT, int Y_COUNT, int Z_COUNT>
+    bool update(LightCube<X_COUNT, Y_COUNT, Z_COUNT> &light, uint32_t deltaTime) {
+        CRGB rgb[light.l()];
+        fill_rainbow(rgb, light.l(), currentHue);
+        for (int z = 0; z < light.h(); z++) {
+            for (int y = 0; y < light.w(); y++) {
+                memcpy(&light.row(y, z)[0], rgb, sizeof(rgb)); // 每行的灯珠是连续的
             }
         }
-        currentHue += delta;
         return true;
     }
 
@@ -371,34 +505,62 @@ public:
         json["delta"] = delta;
     }
 
-    static StreamEffect* readFromJSON(JsonDocument &json) {
+    static StreamEffect* readFromJSON(void *slot, JsonDocument &json) {
         uint8_t direction = json["direction"];
         uint8_t delta = json["delta"];
-        return new StreamEffect(direction, delta);
+        return new (slot) StreamEffect(direction, delta);
+    }
+
+    static StreamEffect* readFromArgs(void *slot, int argc, const char *argv[]) {
+        uint8_t direction = argc > 0 ? atoi(argv[0]) : 0;
+        int8_t delta      = argc > 1 ? atoi(argv[1]) : 1;
+        return new (slot) StreamEffect(direction, delta);
     }
 };
 
+// 动画预读的帧数, 每帧占用 灯珠数 * 3 字节的静态内存
+#ifndef ANIMATION_PREFETCH_FRAMES
+#define ANIMATION_PREFETCH_FRAMES 4
+#endif
+
+/**
+ * 逐帧动画
+ *
+ * 读取文件可能被 Flash 的写入等阻塞, 所以由命令端 (loop) 调用 prefetch 把后续的帧提前解码到环形缓冲中,
+ * 渲染端只按播放进度从内存复制. 帧按从开始播放起的序号编号, 命令端只写 decoded, 渲染端只写 played,
+ * 渲染端跳帧时命令端跟着跳过, 需要的帧还没有解码好时记一次欠载并跳过这一帧.
+ * 预读缓冲是按灯珠数静态分配的一份, 切换动画时旧动画可能还在使用, 新动画等旧动画回收后由命令端接手缓冲,
+ * 同时才打开文件 (AnimationFile 的调色板等缓冲也只有一份), 在此之前渲染端不播放, 也不访问文件.
+ * 安装在 ESP32 动画分区中的动画映射在内存中, 读取不会阻塞, 由渲染端直接解码到灯珠数据, 不使用预读缓冲
+ */
 template <typename LIGHT>
-class AnimationEffect : public Effect {
+class AnimationEffect final : public Effect {
 private:
-    String animName;
-    File file;
-    uint16_t currentFrame;
+    static constexpr uint32_t PREFETCH_FRAMES = ANIMATION_PREFETCH_FRAMES;
+    static_assert(PREFETCH_FRAMES >= 2, "Need at least 2 frames to prefetch");
+
+    static CRGB buffer[PREFETCH_FRAMES * LIGHT::led_count];
+    static bool bufferUsed; // 仅命令端访问
+
+    // 动画名称的最大长度 (含结尾的 0), 与动画分区中条目的名称相同
+    static constexpr size_t NAME_SIZE = 32;
+
+    char animName[NAME_SIZE];
+    AnimationFile file;
+    FrameCounter frames;
+    bool mapped;                   // 播放映射在内存中的动画, 构造后不再改变
+    bool ownsBuffer;               // 仅命令端访问
+    std::atomic<bool> prefetching; // 已接手预读缓冲并解码了第一批帧, 仅命令端写入
+    std::atomic<uint32_t> decoded; // 下一个要解码的帧, 仅命令端写入
+    std::atomic<uint32_t> played;  // 下一个要播放的帧, 仅渲染端写入
+    std::atomic<uint32_t> underruns;
+    bool started;
+
+    CRGB* slot(uint32_t frame) {
+        return buffer + frame % PREFETCH_FRAMES * LIGHT::led_count;
+    }
 
-public:
-    AnimationEffect(const char *animName) :
-        animName(animName), currentFrame(0) {
-        if (strlen(animName) > 0) {
-            String path = String("/animations/") + animName;
-            file = LittleFS.open(path, "r");
-#if defined(ESP8266) || defined(PICO_RP2040)
-            if (!file.isFile()) {
-#elif defined(ESP32)
-            if (file.isDirectory()) {
-#endif
-                file.close();
-            }
-        }
+    void printOpened() {
         if (file) {
             Serial.print(F("Start to play animation: "));
         } else {
@@ -407,85 +569,417 @@ public:
         Serial.println(animName);
     }
 
+public:
+    AnimationEffect(const char *animName) :
+        Effect(ANIMATION), animName{}, mapped(false), ownsBuffer(false), prefetching(false), decoded(0), played(0), underruns(0),
+        started(false) {
+        // 名称过长时不截断, 留空使打开失败, 避免播放到同名前缀的另一个动画
+        if (animName && strlen(animName) < NAME_SIZE) {
+            strcpy(this->animName, animName);
+        } else if (animName) {
+            Serial.println(F("Animation name too long"));
+        }
+        if (this->animName[0]) {
+            const uint8_t *data = nullptr;
+            uint32_t size = 0;
+#if defined(ESP32) && defined(ENABLE_ANIM_PARTITION)
+            data = AnimationPartition::instance().find(this->animName, size); // 优先播放安装到动画分区中的
+#endif
+            if (data) {
+                mapped = true;
+                file.open(data, size, LIGHT::led_count);
+                printOpened();
+                return;
+            }
+        }
+        prefetch();
+    }
+
     ~AnimationEffect() {
         if (file) {
             file.close();
             Serial.println(F("Stop playing animation"));
         }
+        if (ownsBuffer) {
+            bufferUsed = false;
+        }
     }
 
-    EffectType type() override {
-        return ANIMATION;
+    /**
+     * @brief Decode the following frames into the free slots, only for the command side
+     *
+     * @return true if the animation just became ready to play and the render side should be woken
+     */
+    bool prefetch() {
+        bool opened = false;
+        if (!ownsBuffer) {
+            if (mapped || bufferUsed) {
+                return false; // 旧动画回收后再打开文件开始预读
+            }
+            bufferUsed = ownsBuffer = true;
+            if (animName[0]) {
+                char path[sizeof("/animations/") + NAME_SIZE];
+                snprintf_P(path, sizeof(path), PSTR("/animations/%s"), animName);
+                file.open(path, LIGHT::led_count);
+            }
+            printOpened();
+            opened = true;
+        }
+        if (!file) {
+            return false;
+        }
+        uint32_t start = played.load(std::memory_order_acquire);
+        uint32_t next = decoded.load(std::memory_order_relaxed);
+        uint32_t frame = (int32_t) (start - next) > 0 ? start : next; // 跳过渲染端已经错过的帧
+        for (; frame - start < PREFETCH_FRAMES; frame++) {
+            CRGB *leds = slot(frame);
+            if (next > 0 && slot(next - 1) != leds) { // 增量帧在上一次解码的帧上修改
+                memcpy(leds, slot(next - 1), sizeof(CRGB) * LIGHT::led_count);
+            }
+            if (!file.readFrame(frame % file.getFrameCount(), leds, LIGHT::led_count)) {
+                break;
+            }
+            next = frame + 1;
+            decoded.store(next, std::memory_order_release);
+        }
+        prefetching.store(true, std::memory_order_release);
+        return opened;
+    }
+
+    /**
+     * @brief Get the number of frames that were not decoded in time
+     */
+    uint32_t getUnderruns() {
+        return underruns.load(std::memory_order_relaxed);
     }
 
     bool update(Light &light, uint32_t deltaTime) override {
-        if (!file || file.size() == 0) {
+        if (mapped ? !file : !prefetching.load(std::memory_order_acquire)) {
+            return false;
+        }
+        uint32_t count = frames.advance(deltaTime, file.getFrameRate());
+        if (count == 0 && started) { // 第一帧立即播放, 之后按动画自身的帧率播放
+            return false;
+        }
+        uint32_t frame = played.load(std::memory_order_relaxed);
+        if (count > 1) { // 跳过来不及播放的帧
+            frame += count - 1;
+        }
+        if (started && frame / file.getFrameCount() != (frame - count) / file.getFrameCount()) {
+            Serial.println(F("End of animation, replay"));
+        }
+        started = true;
+        if (mapped) { // 映射到内存中的动画直接解码, 不需要预读
+            played.store(frame + 1, std::memory_order_release);
+            return file.readFrame(frame % file.getFrameCount(), light.data(), light.count());
+        }
+        if ((int32_t) (decoded.load(std::memory_order_acquire) - frame) <= 0) {
+            underruns.store(underruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            played.store(frame + 1, std::memory_order_release);
             return false;
         }
 #ifdef ENABLE_DEBUG
-        Serial.printf_P(PSTR("Playing anim frame: %d\n"), currentFrame);
+        Serial.printf_P(PSTR("Playing anim frame: %u\n"), frame % file.getFrameCount());
 #endif
-        int index = 0;
-        while (index < light.count()) {
-            CRGB &pixel = light.data()[index];
-            if (file.read(pixel.raw, sizeof(pixel.raw)) != sizeof(pixel.raw)) {
-                Serial.println(F("End of animation, replay"));
-                file.seek(0);
-                currentFrame = 0;
-                continue;
-            }
-            index++;
-        }
-        currentFrame++;
+        memcpy(light.data(), slot(frame), sizeof(CRGB) * light.count());
+        played.store(frame + 1, std::memory_order_release);
         return true;
     }
 
+    uint32_t nextUpdate() override {
+        bool ready = mapped ? (bool) file : prefetching.load(std::memory_order_acquire);
+        return ready ? frames.untilNext(file.getFrameRate()) : NO_UPDATE; // 接手预读缓冲后由命令端唤醒
+    }
+
     void writeToJSON(JsonDocument &json) override {
         Effect::writeToJSON(json);
         json["animName"] = animName;
     }
 
-    static AnimationEffect* readFromJSON(JsonDocument &json) {
+    static AnimationEffect* readFromJSON(void *slot, JsonDocument &json) {
         const char *animName = json["animName"];
-        return new AnimationEffect(animName);
+        return new (slot) AnimationEffect(animName);
+    }
+
+    static AnimationEffect* readFromArgs(void *slot, int argc, const char *argv[]) {
+        const char *animName = argc > 0 ? argv[0] : "";
+        return new (slot) AnimationEffect(animName);
     }
 };
 
 template <typename LIGHT>
-class MusicEffect : public Effect {
+CRGB AnimationEffect<LIGHT>::buffer[AnimationEffect<LIGHT>::PREFETCH_FRAMES * LIGHT::led_count];
+
+template <typename LIGHT>
+bool AnimationEffect<LIGHT>::bufferUsed = false;
+
+// 音乐律动的平滑参数(可选, 单位毫秒), 上升和下降为音量从 0 到最大所需的时间
+#ifndef MUSIC_ATTACK_MS
+#define MUSIC_ATTACK_MS 40
+#endif
+#ifndef MUSIC_DECAY_MS
+#define MUSIC_DECAY_MS 400
+#endif
+// 峰值标记停留的时间和之后从最大落到 0 所需的时间
+#ifndef MUSIC_PEAK_HOLD_MS
+#define MUSIC_PEAK_HOLD_MS 500
+#endif
+#ifndef MUSIC_PEAK_DECAY_MS
+#define MUSIC_PEAK_DECAY_MS 1000
+#endif
+// 上位机的发送间隔, 收到前两次音量之前按它插值
+#ifndef MUSIC_SAMPLE_INTERVAL_MS
+#define MUSIC_SAMPLE_INTERVAL_MS 50
+#endif
+// 节拍模式下每个节拍闪烁后暗下去的时间和色相的变化
+#ifndef MUSIC_FLASH_MS
+#define MUSIC_FLASH_MS 300
+#endif
+#ifndef MUSIC_BEAT_HUE_STEP
+#define MUSIC_BEAT_HUE_STEP 40
+#endif
+
+/**
+ * 音乐律动
+ *
+ * 每个频段的音量由上位机计算后发送, 可以用 bands 命令查询频段数.
+ * 二进制消息的第一个字节为格式, 之后正好是 music_bands 个音量:
+ *   0x01: 每个频段 1 字节, 255 为最大
+ *   0x02: 每个频段 2 字节小端, 65535 为最大
+ * 也兼容逗号分隔的 0~1 小数文本
+ *
+ * 上位机的发送频率通常比刷新率低, 到达时间也不均匀. 收到新的音量后按估计的发送间隔从当前位置线性过渡过去,
+ * 再经过上升/下降速度限制的包络, 电平模式额外显示缓慢回落的峰值, 所以低频率的输入也能平滑地按刷新率显示
+ *
+ * 收到的音量同时用于检测节拍, 节拍模式下整个灯在每个节拍闪一下并换一个颜色, 估计的速度可以通过 status 命令查看
+ */
+template <typename LIGHT>
+class MusicEffect final : public Effect {
 private:
-    uint8_t soundMode; // 0-电平模式 1-频谱模式
+    static constexpr int BANDS = LIGHT::music_bands;
+    static constexpr int VOLUME_SHIFT = 15; // 音量为定点数, 1 << VOLUME_SHIFT 为最大
+    static constexpr uint32_t VOLUME_ONE = 1 << VOLUME_SHIFT;
+
+    struct Sample {
+        uint16_t volume[BANDS];
+        uint32_t time; // 到达时间 (us)
+    };
+
+    FrameCounter frames;
+    bool changed; // 需要重新渲染
+    bool moving;  // 音量或峰值还在变化, 需要继续刷新
+    uint8_t soundMode; // 0-电平模式 1-频谱模式 2-节拍模式
     uint8_t currentHue;
-    double currentVolume[LIGHT::music_bands]; // Must be 0~1
+    uint16_t inputVolume[BANDS]; // 仅命令端访问, 文本只给出部分频段时其余频段保持不变
+    Mailbox<Sample> samples;     // 渲染端每帧只取最新的音量, 来不及取走的被丢弃
+    // 以下仅渲染端访问
+    bool received;         // 已经收到过音量
+    uint32_t lastTime;     // 上一次音量的到达时间 (us)
+    uint32_t interval;     // 估计的发送间隔 (us)
+    uint32_t elapsed;      // 收到最新音量后经过的时间 (us)
+    uint16_t fromVolume[BANDS];
+    uint16_t toVolume[BANDS];
+    uint16_t currentVolume[BANDS]; // 包络后显示的音量
+    uint16_t peakVolume[BANDS];
+    uint32_t peakHold[BANDS];      // 峰值剩余的停留时间 (us)
+    BeatDetector<BANDS> beats;
+    uint16_t flash;                // 节拍闪烁的亮度
+
+    // 音量对应的格数, 向下取整
+    static int scale(int size, uint16_t volume) {
+        return (size * volume) >> VOLUME_SHIFT;
+    }
+
+    // 经过 deltaTime 后的变化量, duration 为从 0 到最大所需的时间 (ms), 为 0 时直接跳到目标
+    static uint32_t step(uint32_t deltaTime, uint32_t duration) {
+        if (duration == 0) {
+            return VOLUME_ONE;
+        }
+        return std::max<uint32_t>((uint64_t) deltaTime * VOLUME_ONE / (duration * 1000), 1);
+    }
+
+    static uint16_t approach(uint16_t value, uint16_t target, uint32_t step) {
+        if (value < target) {
+            return std::min<uint32_t>(value + step, target);
+        }
+        return value > target + step ? value - step : target;
+    }
+
+    void publish() {
+        Sample &sample = samples.backBuffer();
+        memcpy(sample.volume, inputVolume, sizeof(inputVolume));
+        sample.time = micros();
+        samples.publish();
+    }
+
+    uint16_t interpolate(int band) {
+        return fromVolume[band] + ((int32_t) toVolume[band] - fromVolume[band]) * (int64_t) elapsed / interval;
+    }
+
+    // 插值, 包络, 峰值和节拍, 返回显示的内容是否改变
+    bool smooth(uint32_t deltaTime) {
+        bool beat = false;
+        if (samples.acquire()) {
+            const Sample &sample = samples.frontBuffer();
+            uint32_t time = sample.time;
+            for (int i = 0; i < BANDS; i++) { // 从当前插值到的位置开始过渡
+                fromVolume[i] = interpolate(i);
+                toVolume[i] = sample.volume[i];
+            }
+            if (received) { // 过短或过长的间隔是突发或中断, 限制后再平均
+                uint32_t gap = constrain(time - lastTime, 1000000U / 120, 1000000U / 5);
+                interval = (interval * 3 + gap) / 4;
+            }
+            received = true;
+            lastTime = time;
+            elapsed = 0;
+            beat = beats.feed(toVolume, time);
+        }
+        elapsed = std::min(elapsed + deltaTime, interval);
+
+        uint32_t attack = step(deltaTime, MUSIC_ATTACK_MS);
+        uint32_t decay = step(deltaTime, MUSIC_DECAY_MS);
+        uint32_t fall = step(deltaTime, MUSIC_PEAK_DECAY_MS);
+        bool updated = false;
+        moving = elapsed < interval;
+        if (soundMode == 2) {
+            uint16_t next = beat ? VOLUME_ONE : approach(flash, 0, step(deltaTime, MUSIC_FLASH_MS));
+            if (beat) {
+                currentHue += MUSIC_BEAT_HUE_STEP;
+            }
+            updated |= next != flash || beat;
+            moving |= next > 0;
+            flash = next;
+        }
+        for (int i = 0; i < BANDS; i++) {
+            uint16_t target = interpolate(i);
+            uint16_t volume = approach(currentVolume[i], target, target > currentVolume[i] ? attack : decay);
+            uint16_t peak = peakVolume[i];
+            if (volume >= peak) {
+                peak = volume;
+                peakHold[i] = MUSIC_PEAK_HOLD_MS * 1000;
+            } else if (peakHold[i] > deltaTime) {
+                peakHold[i] -= deltaTime;
+            } else {
+                peakHold[i] = 0;
+                peak = approach(peak, volume, fall);
+            }
+            updated |= volume != currentVolume[i] || peak != peakVolume[i];
+            moving |= volume != target || peak != volume;
+            currentVolume[i] = volume;
+            peakVolume[i] = peak;
+        }
+        return updated;
+    }
 
 public:
     MusicEffect(uint8_t mode) :
-        soundMode(mode), currentHue(0), currentVolume{0.0} {}
+        Effect(MUSIC), changed(true), moving(false), soundMode(mode), currentHue(0), inputVolume{0},
+        received(false), lastTime(0), interval(MUSIC_SAMPLE_INTERVAL_MS * 1000), elapsed(0),
+        fromVolume{0}, toVolume{0}, currentVolume{0}, peakVolume{0}, peakHold{0}, flash(0) {}
+
+    /**
+     * @brief Set the volume of the first bands from text input
+     *
+     * @param volumes volumes between 0 and 1
+     * @param count number of volumes, the other bands are unchanged
+     */
+    void setVolumes(const float *volumes, int count) {
+        for (int i = 0; i < count && i < BANDS; i++) {
+            // 换算时向上取整, 避免 0.4 这类音量乘以灯珠数后因为舍入少亮一颗
+            inputVolume[i] = ceilf(constrain(volumes[i], 0.0f, 1.0f) * VOLUME_ONE);
+        }
+        publish();
+    }
+
+    /**
+     * @brief Set the volume of all bands from a binary message
+     *
+     * @param data message starting with the format byte
+     * @param length length of data
+     * @return true if the message has the right format and band count
+     */
+    bool setVolumes(const uint8_t *data, size_t length) {
+        if (length == 1 + BANDS && data[0] == 0x01) {
+            for (int i = 0; i < BANDS; i++) {
+                inputVolume[i] = ((data[1 + i] << VOLUME_SHIFT) + 254) / 255;
+            }
+        } else if (length == 1 + BANDS * 2 && data[0] == 0x02) {
+            for (int i = 0; i < BANDS; i++) {
+                uint32_t volume = data[1 + i * 2] | data[2 + i * 2] << 8;
+                inputVolume[i] = ((volume << VOLUME_SHIFT) + 65534) / 65535;
+            }
+        } else {
+            return false;
+        }
+        publish();
+        return true;
+    }
+
+    /**
+     * @brief Get the tempo estimated from the received volumes
+     *
+     * @return uint16_t beats per minute, 0 if unknown
+     */
+    uint16_t getBPM() {
+        return beats.getBPM();
+    }
 
-    void setVolume(int index, double volume) {
-        currentVolume[index] = volume;
+    /**
+     * @brief Get the number of received volumes replaced before being rendered
+     */
+    uint32_t getDropped() {
+        return samples.getDropped();
     }
 
-    EffectType type() override {
-        return MUSIC;
+    /**
+     * @brief Set the volume of all bands, used by the microphone
+     *
+     * @param volumes Q15 volumes
+     */
+    void setVolumes(const uint16_t *volumes) {
+        memcpy(inputVolume, volumes, sizeof(inputVolume));
+        publish();
     }
 
     bool update(Light &light, uint32_t deltaTime) override {
+        uint32_t count = frames.advance(deltaTime);
+        bool updated = smooth(deltaTime);
+        if (soundMode == 1) { // 频谱模式的颜色随时间变化
+            currentHue += count;
+            updated |= count > 0;
+        }
+        if (!changed && !updated) {
+            return false;
+        }
+        changed = false;
+        if (soundMode == 2) { // 节拍模式与灯的形态无关
+            CHSV hsv(currentHue, 255, (240 * flash) >> VOLUME_SHIFT);
+            CRGB rgb;
+            hsv2rgb_rainbow(hsv, rgb);
+            fill_solid(light.data(), light.count(), rgb);
+            return true;
+        }
         return update(static_cast<LIGHT&>(light), deltaTime);
     }
 
+    uint32_t nextUpdate() override {
+        return soundMode != 1 && !moving ? NO_UPDATE : frames.untilNext();
+    }
+
     template <int COUNT, bool REVERSE>
     bool update(LightStrip<COUNT, REVERSE> &light, uint32_t deltaTime) {
         if (soundMode == 0) {
-            int count = light.l() * currentVolume[0];
+            int count = scale(light.l(), currentVolume[0]);
+            int peak = scale(light.l(), peakVolume[0]);
             fill_solid(light.data(), light.count(), CRGB::Black);
-            if (count > 0) {
-                fill_solid(light.data(), count - 1, CRGB::Green);
-                light.at(count - 1) = CRGB::Red;
+            fill_solid(light.data(), count, CRGB::Green);
+            if (peak > 0) {
+                light.at(peak - 1) = CRGB::Red;
             }
         } else {
-            int count = light.l() * currentVolume[0];
-            CHSV hsv(currentHue++, 255, 240);
+            int count = scale(light.l(), currentVolume[0]);
+            CHSV hsv(currentHue, 255, 240);
             CRGB rgb;
             hsv2rgb_rainbow(hsv, rgb);
             fill_solid(light.data(), light.count(), CRGB::Black);
@@ -499,25 +993,26 @@ public:
         if (soundMode == 0) {
             fill_solid(light.data(), light.count(), CRGB::Black);
             for (int x = 0; x < light.w(); x++) {
-                int count = light.h() * currentVolume[x];
-                if (count > 0) {
-                    for (int y = 0; y < count; y++) {
-                        light.at(x, y) = CRGB::Green;
-                    }
-                    light.at(x, count - 1) = CRGB::Red;
+                PixelRange column = light.column(x);
+                int count = scale(column.size(), currentVolume[x]);
+                int peak = scale(column.size(), peakVolume[x]);
+                for (int y = 0; y < count; y++) {
+                    column[y] = CRGB::Green;
+                }
+                if (peak > 0) {
+                    column[peak - 1] = CRGB::Red;
                 }
             }
         } else {
-            CHSV hsv(currentHue++, 255, 240);
+            CHSV hsv(currentHue, 255, 240);
             CRGB rgb;
             hsv2rgb_rainbow(hsv, rgb);
             fill_solid(light.data(), light.count(), CRGB::Black);
             for (int x = 0; x < light.w(); x++) {
-                int count = light.h() * currentVolume[x];
-                if (count > 0) {
-                    for (int y = 0; y < count; y++) {
-                        light.at(x, y) = rgb;
-                    }
+                PixelRange column = light.column(x);
+                int count = scale(column.size(), currentVolume[x]);
+                for (int y = 0; y < count; y++) {
+                    column[y] = rgb;
                 }
             }
         }
@@ -527,32 +1022,58 @@ public:
     template <int ARRANGEMENT, int... COUNT_PER_RING>
     bool update(LightDisc<ARRANGEMENT, COUNT_PER_RING...> &light, uint32_t deltaTime) {
         if (soundMode == 0) {
-            int r = light.r() * currentVolume[0];
+            int r = scale(light.r(), currentVolume[0]);
+            int peak = scale(light.r(), peakVolume[0]);
             fill_solid(light.data(), light.count(), CRGB::Black);
-            if (r > 0) {
-                for (int i = 0; i < r; i++) {
-                    for (int j = 0; j < light.l(i); j++) {
-                        light.at(i, j) = CRGB::Green;
-                    }
+            for (int i = 0; i < r; i++) {
+                for (CRGB &led : light.ring(i)) {
+                    led = CRGB::Green;
                 }
-                int l = light.l(r - 1);
-                for (int j = 0; j < l; j++) {
-                    light.at(r - 1, j) = CRGB::Red;
+            }
+            if (peak > 0) {
+                for (CRGB &led : light.ring(peak - 1)) {
+                    led = CRGB::Red;
                 }
             }
         } else {
-            int r = ceil(light.r() * currentVolume[0]);
-            CHSV hsv(currentHue++, 255, 240);
+            uint32_t level = light.r() * currentVolume[0]; // 定点数, 小数部分为最外圈的亮度
+            int r = std::min<int>((level + VOLUME_ONE - 1) >> VOLUME_SHIFT, light.r());
+            CHSV hsv(currentHue, 255, 240);
             CRGB rgb;
             hsv2rgb_rainbow(hsv, rgb);
             fill_solid(light.data(), light.count(), CRGB::Black);
             for (int i = light.r() - r; i < light.r(); i++) {
                 CRGB temp = rgb;
                 if (i == light.r() - r) {
-                    temp.nscale8_video(255 * (currentVolume[0] - floor(light.r() * currentVolume[0]) / light.r()) * light.r());
+                    temp.nscale8_video(((level & (VOLUME_ONE - 1)) * 255) >> VOLUME_SHIFT);
+                }
+                for (CRGB &led : light.ring(i)) {
+                    led = temp;
+                }
+            }
+        }
+        return true;
+    }
+
+    template <int X_COUNT, int Y_COUNT, int Z_COUNT>
+    bool update(LightCube<X_COUNT, Y_COUNT, Z_COUNT> &light, uint32_t deltaTime) {
+        CRGB rgb = CRGB::Green;
+        if (soundMode != 0) {
+            CHSV hsv(currentHue, 255, 240);
+            hsv2rgb_rainbow(hsv, rgb);
+        }
+        fill_solid(light.data(), light.count(), CRGB::Black);
+        for (int y = 0; y < light.w(); y++) {
+            for (int x = 0; x < light.l(); x++) {
+                int band = y * light.l() + x;
+                PixelRange column = light.column(x, y);
+                int count = scale(column.size(), currentVolume[band]);
+                for (int z = 0; z < count; z++) {
+                    column[z] = rgb;
                 }
-                for (int j = 0; j < light.l(i); j++) {
-                    light.at(i, j) = temp;
+                int peak = scale(column.size(), peakVolume[band]);
+                if (soundMode == 0 && peak > 0) {
+                    column[peak - 1] = CRGB::Red;
                 }
             }
         }
@@ -564,67 +1085,368 @@ public:
         json["soundMode"] = soundMode;
     }
 
-    static MusicEffect* readFromJSON(JsonDocument &json) {
+    static MusicEffect* readFromJSON(void *slot, JsonDocument &json) {
         uint8_t soundMode = json["soundMode"];
-        return new MusicEffect(soundMode);
+        return new (slot) MusicEffect(soundMode);
+    }
+
+    static MusicEffect* readFromArgs(void *slot, int argc, const char *argv[]) {
+        uint8_t soundMode = argc > 0 ? atoi(argv[0]) : 1;
+        return new (slot) MusicEffect(soundMode);
     }
 };
 
+/**
+ * 上位机控制的自定义灯效
+ *
+ * 上位机发来的帧先写入三缓冲, 渲染时整帧替换到 light 中, 不会输出只写了一半的帧.
+ * 灯珠按接线顺序排列, 二进制帧的第一个字节为格式, 多字节整数均为小端:
+ *   0x01 RGB:    每颗灯珠 3 字节
+ *   0x02 RGB565: 每颗灯珠 2 字节
+ *   0x03 调色板: 1 字节颜色数 N (0 表示 256), N * 3 字节颜色, 然后每颗灯珠 1 字节序号
+ *   0x04 增量:   若干个片段, 每段为 2 字节起始位置, 1 字节数量 n, n * 3 字节颜色, 其余灯珠保持不变
+ * 兼容逐个发送 #RRGGBB 的文本协议, 一行中可以有多个以逗号或空白分隔的颜色, 先写入命令端的缓冲, 整行写完后才发布一帧
+ */
 template <typename LIGHT>
-class CustomEffect : public Effect {
+class CustomEffect final : public Effect {
 private:
+    enum FrameFormat {
+        FRAME_RGB = 0x01,
+        FRAME_RGB565 = 0x02,
+        FRAME_PALETTE = 0x03,
+        FRAME_DELTA = 0x04,
+    };
+
+    static FrameBuffer<LIGHT::led_count> frames;
+    static CRGB *last; // 上一次发布的帧, 增量帧在它的基础上修改, 仅命令端访问
+    CRGB *staged; // 文本协议正在写入还未发布的帧
     int index;
+    bool restored; // 已重新显示过上位机的上一帧, 仅渲染端访问
+
+    // 取一块空闲的缓冲写入新的一帧, keep 为 true 时先复制上一帧
+    static CRGB* beginFrame(bool keep) {
+        CRGB *frame = frames.backBuffer();
+        if (keep && last) {
+            memcpy(frame, last, sizeof(CRGB) * LIGHT::led_count);
+        } else if (keep) {
+            fill_solid(frame, LIGHT::led_count, CRGB::Black);
+        }
+        return frame;
+    }
+
+    static void endFrame(CRGB *frame) {
+        frames.publish();
+        last = frame;
+    }
+
+    static bool readDelta(CRGB *frame, const uint8_t *data, size_t length) {
+        while (length > 0) {
+            if (length < 3) {
+                return false;
+            }
+            uint16_t start = data[0] | data[1] << 8;
+            uint8_t count = data[2];
+            data += 3;
+            length -= 3;
+            if (start + count > LIGHT::led_count || length < count * 3U) {
+                return false;
+            }
+            for (int i = 0; i < count; i++, data += 3) {
+                frame[start + i] = CRGB(data[0], data[1], data[2]);
+            }
+            length -= count * 3;
+        }
+        return true;
+    }
+
+    static bool readFrame(CRGB *frame, const uint8_t *data, size_t length) {
+        const int count = LIGHT::led_count;
+        switch (data[0]) {
+            case FRAME_RGB:
+                if (length != 1 + count * 3U) {
+                    return false;
+                }
+                memcpy(frame, data + 1, count * 3);
+                return true;
+            case FRAME_RGB565:
+                if (length != 1 + count * 2U) {
+                    return false;
+                }
+                for (int i = 0; i < count; i++) {
+                    uint16_t color = data[1 + i * 2] | data[2 + i * 2] << 8;
+                    uint8_t r = color >> 11, g = (color >> 5) & 0x3F, b = color & 0x1F;
+                    frame[i] = CRGB(r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2);
+                }
+                return true;
+            case FRAME_PALETTE: {
+                if (length < 2) {
+                    return false;
+                }
+                int colors = data[1] ? data[1] : 256;
+                const uint8_t *palette = data + 2;
+                const uint8_t *indices = palette + colors * 3;
+                if (length != 2 + colors * 3U + count) {
+                    return false;
+                }
+                for (int i = 0; i < count; i++) {
+                    if (indices[i] >= colors) {
+                        return false;
+                    }
+                    const uint8_t *color = palette + indices[i] * 3;
+                    frame[i] = CRGB(color[0], color[1], color[2]);
+                }
+                return true;
+            }
+            case FRAME_DELTA:
+                return readDelta(frame, data + 1, length - 1);
+            default:
+                return false;
+        }
+    }
 
 public:
-    CustomEffect() : index(0) {}
+    CustomEffect() : Effect(CUSTOM), staged(nullptr), index(0), restored(false) {}
+
+    /**
+     * @brief Write the next pixel of the text protocol, only for the command side
+     *
+     * The pixel is staged and shown after commitPixels()
+     *
+     * @param color color of the pixel, the position wraps around after the last pixel
+     */
+    void writePixel(const CRGB &color) {
+        if (!staged) {
+            staged = beginFrame(true);
+        }
+        staged[index++] = color;
+        if (index >= LIGHT::led_count) {
+            index = 0;
+        }
+    }
 
-    int& getIndex() {
-        return index;
+    /**
+     * @brief Publish the pixels written since the last commit, only for the command side
+     *
+     * @return true if there are pixels to show on the next update
+     */
+    bool commitPixels() {
+        if (!staged) {
+            return false;
+        }
+        endFrame(staged);
+        staged = nullptr;
+        return true;
     }
 
-    EffectType type() override {
-        return CUSTOM;
+    /**
+     * @brief Receive a binary frame, only for the command side
+     *
+     * @param data frame starting with the format byte
+     * @param length length of data
+     * @return true if the frame is valid and will be shown on the next update
+     */
+    bool writeFrame(const uint8_t *data, size_t length) {
+        if (length == 0) {
+            return false;
+        }
+        commitPixels(); // 文本协议写入的像素在这一帧之前生效
+        CRGB *frame = beginFrame(data[0] == FRAME_DELTA);
+        if (!readFrame(frame, data, length)) {
+            return false; // 没有发布, 写了一半的缓冲会在下一帧被覆盖
+        }
+        endFrame(frame);
+        index = 0; // 二进制帧之后文本协议从头开始
+        return true;
+    }
+
+    /**
+     * @brief Get the number of frames replaced before being rendered
+     */
+    static uint32_t getDropped() {
+        return frames.getDropped();
     }
 
     bool update(Light &light, uint32_t deltaTime) override {
+        // 切换到自定义灯效后第一次刷新时重新显示上位机的上一帧, 它就在渲染端的前缓冲中, 不需要再发布一次
+        bool fresh = frames.acquire();
+        if (!fresh && (restored || frames.getPublished() == 0)) {
+            return false;
+        }
+        restored = true;
+        memcpy(light.data(), frames.frontBuffer(), sizeof(CRGB) * light.count());
         return true;
     }
 
+    uint32_t nextUpdate() override {
+        return NO_UPDATE;
+    }
+
     void writeToJSON(JsonDocument &json) override {
         Effect::writeToJSON(json);
     }
 
-    static CustomEffect* readFromJSON(JsonDocument &json) {
-        return new CustomEffect();
+    static CustomEffect* readFromJSON(void *slot, JsonDocument &json) {
+        return new (slot) CustomEffect();
+    }
+
+    static CustomEffect* readFromArgs(void *slot, int argc, const char *argv[]) {
+        return new (slot) CustomEffect();
     }
 };
 
 template <typename LIGHT>
-Effect* Effect::readFromJSON(JsonDocument &json) {
+FrameBuffer<LIGHT::led_count> CustomEffect<LIGHT>::frames;
+
+template <typename LIGHT>
+CRGB *CustomEffect<LIGHT>::last = nullptr;
+
+template <typename LIGHT>
+Effect* Effect::readFromJSON(void *slot, JsonDocument &json) {
     if (json.containsKey("mode")) {
         EffectType mode = json["mode"].as<EffectType>();
         switch (mode) {
             case CONSTANT:
-                return ConstantEffect<LIGHT>::readFromJSON(json);
+                return ConstantEffect<LIGHT>::readFromJSON(slot, json);
             case BLINK:
-                return BlinkEffect<LIGHT>::readFromJSON(json);
+                return BlinkEffect<LIGHT>::readFromJSON(slot, json);
             case BREATH:
-                return BreathEffect<LIGHT>::readFromJSON(json);
+                return BreathEffect<LIGHT>::readFromJSON(slot, json);
             case CHASE:
-                return ChaseEffect<LIGHT>::readFromJSON(json);
+                return ChaseEffect<LIGHT>::readFromJSON(slot, json);
             case RAINBOW:
-                return RainbowEffect<LIGHT>::readFromJSON(json);
+                return RainbowEffect<LIGHT>::readFromJSON(slot, json);
             case STREAM:
-                return StreamEffect<LIGHT>::readFromJSON(json);
+                return StreamEffect<LIGHT>::readFromJSON(slot, json);
             case ANIMATION:
-                return AnimationEffect<LIGHT>::readFromJSON(json);
+                return AnimationEffect<LIGHT>::readFromJSON(slot, json);
             case MUSIC:
-                return MusicEffect<LIGHT>::readFromJSON(json);
+                return MusicEffect<LIGHT>::readFromJSON(slot, json);
             case CUSTOM:
-                return CustomEffect<LIGHT>::readFromJSON(json);
+                return CustomEffect<LIGHT>::readFromJSON(slot, json);
+            default:
+                break;
         }
     }
-    return new ConstantEffect<LIGHT>(DEFAULT_COLOR); // 默认为常亮
+    return new (slot) ConstantEffect<LIGHT>(DEFAULT_COLOR); // 默认为常亮
 }
 
+template <typename LIGHT>
+Effect* Effect::readFromArgs(void *slot, EffectType type, int argc, const char *argv[]) {
+    switch (type) {
+        case CONSTANT:
+            return ConstantEffect<LIGHT>::readFromArgs(slot, argc, argv);
+        case BLINK:
+            return BlinkEffect<LIGHT>::readFromArgs(slot, argc, argv);
+        case BREATH:
+            return BreathEffect<LIGHT>::readFromArgs(slot, argc, argv);
+        case CHASE:
+            return ChaseEffect<LIGHT>::readFromArgs(slot, argc, argv);
+        case RAINBOW:
+            return RainbowEffect<LIGHT>::readFromArgs(slot, argc, argv);
+        case STREAM:
+            return StreamEffect<LIGHT>::readFromArgs(slot, argc, argv);
+        case ANIMATION:
+            return AnimationEffect<LIGHT>::readFromArgs(slot, argc, argv);
+        case MUSIC:
+            return MusicEffect<LIGHT>::readFromArgs(slot, argc, argv);
+        case CUSTOM:
+            return CustomEffect<LIGHT>::readFromArgs(slot, argc, argv);
+        default:
+            return nullptr;
+    }
+}
+
+// 具体灯效类均为 final, 按类型转换后编译器可以直接调用, 渲染时不经过虚函数.
+// light 要以基类传入, 否则会匹配到各形态的重载而跳过 update(Light &) 中的公共逻辑
+template <typename LIGHT>
+bool Effect::dispatchUpdate(Effect *effect, LIGHT &lightType, uint32_t deltaTime) {
+    Light &light = lightType;
+    switch (effect->type()) {
+        case CONSTANT:
+            return static_cast<ConstantEffect<LIGHT>*>(effect)->update(light, deltaTime);
+        case BLINK:
+            return static_cast<BlinkEffect<LIGHT>*>(effect)->update(light, deltaTime);
+        case BREATH:
+            return static_cast<BreathEffect<LIGHT>*>(effect)->update(light, deltaTime);
+        case CHASE:
+            return static_cast<ChaseEffect<LIGHT>*>(effect)->update(light, deltaTime);
+        case RAINBOW:
+            return static_cast<RainbowEffect<LIGHT>*>(effect)->update(light, deltaTime);
+        case STREAM:
+            return static_cast<StreamEffect<LIGHT>*>(effect)->update(light, deltaTime);
+        case ANIMATION:
+            return static_cast<AnimationEffect<LIGHT>*>(effect)->update(light, deltaTime);
+        case MUSIC:
+            return static_cast<MusicEffect<LIGHT>*>(effect)->update(light, deltaTime);
+        case CUSTOM:
+            return static_cast<CustomEffect<LIGHT>*>(effect)->update(light, deltaTime);
+        default:
+            return false;
+    }
+}
+
+template <typename LIGHT>
+uint32_t Effect::dispatchNextUpdate(Effect *effect) {
+    switch (effect->type()) {
+        case CONSTANT:
+            return static_cast<ConstantEffect<LIGHT>*>(effect)->nextUpdate();
+        case BLINK:
+            return static_cast<BlinkEffect<LIGHT>*>(effect)->nextUpdate();
+        case BREATH:
+            return static_cast<BreathEffect<LIGHT>*>(effect)->nextUpdate();
+        case CHASE:
+            return static_cast<ChaseEffect<LIGHT>*>(effect)->nextUpdate();
+        case RAINBOW:
+            return static_cast<RainbowEffect<LIGHT>*>(effect)->nextUpdate();
+        case STREAM:
+            return static_cast<StreamEffect<LIGHT>*>(effect)->nextUpdate();
+        case ANIMATION:
+            return static_cast<AnimationEffect<LIGHT>*>(effect)->nextUpdate();
+        case MUSIC:
+            return static_cast<MusicEffect<LIGHT>*>(effect)->nextUpdate();
+        case CUSTOM:
+            return static_cast<CustomEffect<LIGHT>*>(effect)->nextUpdate();
+        default:
+            return NO_UPDATE;
+    }
+}
+
+constexpr size_t maxOf(size_t value) {
+    return value;
+}
+
+template <typename... Args>
+constexpr size_t maxOf(size_t first, Args... rest) {
+    return first > maxOf(rest...) ? first : maxOf(rest...);
+}
+
+/**
+ * 能放下任意灯效的存储空间大小和对齐
+ */
+template <typename LIGHT>
+struct EffectStorage {
+    static constexpr size_t size = maxOf(
+        sizeof(ConstantEffect<LIGHT>),
+        sizeof(BlinkEffect<LIGHT>),
+        sizeof(BreathEffect<LIGHT>),
+        sizeof(ChaseEffect<LIGHT>),
+        sizeof(RainbowEffect<LIGHT>),
+        sizeof(StreamEffect<LIGHT>),
+        sizeof(AnimationEffect<LIGHT>),
+        sizeof(MusicEffect<LIGHT>),
+        sizeof(CustomEffect<LIGHT>)
+    );
+    static constexpr size_t align = maxOf(
+        alignof(ConstantEffect<LIGHT>),
+        alignof(BlinkEffect<LIGHT>),
+        alignof(BreathEffect<LIGHT>),
+        alignof(ChaseEffect<LIGHT>),
+        alignof(RainbowEffect<LIGHT>),
+        alignof(StreamEffect<LIGHT>),
+        alignof(AnimationEffect<LIGHT>),
+        alignof(MusicEffect<LIGHT>),
+        alignof(CustomEffect<LIGHT>)
+    );
+};
+
 #endif // __LIGHTEFFECT_HPP__
@@ -0,0 +1,99 @@
+#ifndef __MAILBOX_HPP__
+#define __MAILBOX_HPP__
+
+#include <atomic>
+#include <Arduino.h>
+
+/**
+ * 只保留最新值的单生产者单消费者信箱
+ *
+ * 生产端把数据写入后缓冲并与中间缓冲交换, 消费端再把中间缓冲换到前缓冲后读取,
+ * 交换只需一次原子操作, 双方都不会阻塞, 正在读取的数据也不会被改写.
+ * ESP8266 的工具链没有提供原子交换所需的 libatomic, 改为关中断完成交换, 单核上同样不会被打断.
+ * 生产端比消费端快时, 还没被取走的旧数据直接被新数据替换并计入丢弃数, 所以积压永远不超过一份
+ */
+template <typename T>
+class Mailbox {
+private:
+    static constexpr uint32_t FRESH = 0x4; // 中间缓冲中有尚未取走的新数据
+    static constexpr uint32_t INDEX = 0x3;
+
+    T buffers[3];
+    std::atomic<uint32_t> pending;
+    uint32_t back;  // 仅生产端访问
+    uint32_t front; // 仅消费端访问
+    // 仅生产端写入
+    std::atomic<uint32_t> published;
+    std::atomic<uint32_t> dropped;
+
+    uint32_t swap(uint32_t value) {
+#if defined(ESP8266)
+        uint32_t state = xt_rsil(15);
+        uint32_t old = pending.load(std::memory_order_relaxed);
+        pending.store(value, std::memory_order_relaxed);
+        xt_wsr_ps(state);
+        return old;
+#else
+        return pending.exchange(value, std::memory_order_acq_rel);
+#endif
+    }
+
+public:
+    Mailbox() : pending(1), back(0), front(2), published(0), dropped(0) {}
+
+    /**
+     * @brief Get the buffer to write the next value into, called by the producer
+     */
+    T &backBuffer() {
+        return buffers[back];
+    }
+
+    /**
+     * @brief Publish the value written into backBuffer(), called by the producer
+     *
+     * @return false if the previous value was not taken yet and is dropped
+     */
+    bool publish() {
+        uint32_t old = swap(back | FRESH);
+        back = old & INDEX;
+        published.store(published.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (old & FRESH) {
+            dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Take the latest published value, called by the consumer
+     *
+     * @return true if a new value is available in frontBuffer()
+     */
+    bool acquire() {
+        if (!(pending.load(std::memory_order_acquire) & FRESH)) {
+            return false;
+        }
+        front = swap(front) & INDEX;
+        return true;
+    }
+
+    T &frontBuffer() {
+        return buffers[front];
+    }
+
+    /**
+     * @brief Number of published values, safe for both sides
+     */
+    uint32_t getPublished() {
+        return published.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Number of values replaced before the consumer took them, safe for both sides
+     */
+    uint32_t getDropped() {
+        return dropped.load(std::memory_order_relaxed);
+    }
+};
+
+#endif // __MAILBOX_HPP__
@@ -0,0 +1,258 @@
+#ifndef __MICROPHONE_HPP__
+#define __MICROPHONE_HPP__
+
+#include "config.h"
+
+#ifdef ENABLE_MICROPHONE
+
+#include <math.h>
+#include <Arduino.h>
+
+#if defined(ESP32)
+#include <esp_idf_version.h>
+#include <driver/i2s.h>
+#elif defined(ESP8266)
+#error "Microphone input is not supported on ESP8266"
+#elif defined(MIC_ADC_PIN)
+#include <ADCInput.h>
+#else
+#include <I2S.h> // RP2040, 模拟器中由 WAV 文件代替
+#endif
+
+#include "FixedFFT.hpp"
+
+// I2S 麦克风的引脚, RP2040 上 WS 固定为 SCK + 1
+#ifndef MIC_I2S_SCK
+#define MIC_I2S_SCK 26
+#endif
+#ifndef MIC_I2S_WS
+#define MIC_I2S_WS 27
+#endif
+#ifndef MIC_I2S_SD
+#define MIC_I2S_SD 28
+#endif
+// 采样率 (Hz)
+#ifndef MIC_SAMPLE_RATE
+#define MIC_SAMPLE_RATE 16000
+#endif
+// 分频段的频率范围 (Hz), 与网页端相同
+#ifndef MIC_MIN_FREQ
+#define MIC_MIN_FREQ 150
+#endif
+#ifndef MIC_MAX_FREQ
+#define MIC_MAX_FREQ 6000
+#endif
+// 收到网页端的音量后暂停使用麦克风的时间 (ms)
+#ifndef MIC_HOLDOFF_MS
+#define MIC_HOLDOFF_MS 2000
+#endif
+// 最响的频段往下多少分贝以内映射到音量 0~1
+#ifndef MIC_DYNAMIC_RANGE_DB
+#define MIC_DYNAMIC_RANGE_DB 30
+#endif
+
+/**
+ * 麦克风采集音乐律动的音量
+ *
+ * 样本在 loop 中以非阻塞的方式读取, 每凑够半个窗口做一次 512 点的定点数 FFT, 每次 poll 最多做一次,
+ * 处理不过来时直接用最新的窗口, 所以每次调用的耗时有上限, 延迟也不会累积.
+ * 频谱经过 A 计权后按对数间隔合并成 BANDS 个频段, 再换算为分贝, 以最近最响的频段为基准自动调整增益
+ */
+template <int BANDS>
+class Microphone {
+private:
+    static constexpr int FFT_SIZE = 512;
+    static constexpr int HOP = FFT_SIZE / 2;
+    static constexpr int READ_SIZE = 64;
+    // 以 1/256 个 log2 为单位, 6.02dB 为一个 log2
+    static constexpr int32_t RANGE = MIC_DYNAMIC_RANGE_DB * 256 * 100 / 602;
+    static constexpr int32_t REFERENCE_FLOOR = 8 * 256; // 基准最低的幅值, 更安静时视为没有声音
+    static constexpr int32_t REFERENCE_DECAY = 256 * HOP / MIC_SAMPLE_RATE; // 基准每秒下降约 6dB
+
+#if defined(ESP32)
+    static constexpr i2s_port_t PORT = I2S_NUM_0;
+#elif defined(MIC_ADC_PIN)
+    ADCInput adc;
+#else
+    I2S i2s;
+#endif
+    FixedFFT<FFT_SIZE> fft;
+    int16_t samples[FFT_SIZE]; // 环形缓冲, 保存最新的一个窗口
+    int head;
+    int fresh;                 // 上次 FFT 后的新样本数
+    int32_t dc;                // 直流分量, 以 1/256 为单位
+    int16_t window[FFT_SIZE];
+    uint16_t weight[FFT_SIZE / 2]; // 每个频点的 A 计权, Q15
+    uint16_t edges[BANDS + 1];     // 每个频段的起始频点
+    int32_t reference;             // 最近最响的频段, log2 值
+    int16_t frame[FFT_SIZE];
+    uint32_t spectrum[FFT_SIZE / 2];
+
+    // A 计权的增益, 未归一化
+    static float aWeighting(float f) {
+        float f2 = f * f;
+        return 148693636.0f * f2 * f2 /
+            ((f2 + 424.36f) * sqrtf((f2 + 11599.29f) * (f2 + 544496.41f)) * (f2 + 148693636.0f));
+    }
+
+    // 近似的 log2, 以 1/256 为单位
+    static int32_t log2q8(uint32_t x) {
+        if (x == 0) {
+            return 0;
+        }
+        int msb = 31 - __builtin_clz(x);
+        uint32_t fraction = msb >= 8 ? x >> (msb - 8) : x << (8 - msb);
+        return msb * 256 + (fraction & 0xFF);
+    }
+
+    void push(int32_t sample) {
+        dc += ((sample << 8) - dc) >> 10; // 一阶高通去掉直流, 模拟麦克风的偏置较大
+        sample -= dc >> 8;
+        samples[head] = constrain(sample, -32768, 32767);
+        head = (head + 1) % FFT_SIZE;
+        fresh++;
+    }
+
+    // 非阻塞地读取样本, 最多读一个窗口
+    void read() {
+        int count = 0;
+#if defined(ESP32)
+        int32_t buffer[READ_SIZE];
+        size_t bytes = 0;
+        while (i2s_read(PORT, buffer, sizeof(buffer), &bytes, 0) == ESP_OK && bytes > 0) {
+            for (size_t i = 0; i < bytes / sizeof(int32_t); i++) {
+                push(buffer[i] >> 14); // 24 位数据左对齐, 保留高位并留出一些增益
+            }
+            count += bytes / sizeof(int32_t);
+            if (count >= FFT_SIZE) {
+                break;
+            }
+        }
+#elif defined(MIC_ADC_PIN)
+        while (count < FFT_SIZE && adc.available() > 0) {
+            push((adc.read() - 2048) << 4); // 12 位无符号
+            count++;
+        }
+#else
+        while (count < FFT_SIZE && i2s.available() > 0) {
+            int32_t left, right;
+            if (!i2s.read32(&left, &right)) {
+                break;
+            }
+            push(left >> 14);
+            count++;
+        }
+#endif
+    }
+
+    void analyze(uint16_t *volumes) {
+        for (int i = 0; i < FFT_SIZE; i++) {
+            frame[i] = (samples[(head + i) % FFT_SIZE] * window[i]) >> 15;
+        }
+        fft.process(frame, spectrum);
+
+        int32_t levels[BANDS];
+        int32_t loudest = 0;
+        for (int i = 0; i < BANDS; i++) {
+            int width = edges[i + 1] - edges[i];
+            if (width == 0) { // 挤到末尾的频段没有频点, 沿用前一个频段
+                levels[i] = i > 0 ? levels[i - 1] : 0;
+                continue;
+            }
+            uint32_t sum = 0;
+            for (int k = edges[i]; k < edges[i + 1]; k++) {
+                sum += (spectrum[k] * weight[k]) >> 15;
+            }
+            // 幅值放大 256 倍后再取对数, 保留低位的精度
+            levels[i] = log2q8((sum << 8) / width);
+            loudest = std::max(loudest, levels[i]);
+        }
+        reference = std::max(loudest, reference - REFERENCE_DECAY);
+        if (reference < REFERENCE_FLOOR) {
+            reference = REFERENCE_FLOOR;
+        }
+        for (int i = 0; i < BANDS; i++) {
+            int32_t level = levels[i] - (reference - RANGE);
+            volumes[i] = constrain(level, 0, RANGE) * (1 << 15) / RANGE;
+        }
+    }
+
+public:
+    Microphone() :
+#if !defined(ESP32) && defined(MIC_ADC_PIN)
+        adc(MIC_ADC_PIN),
+#elif !defined(ESP32)
+        i2s(INPUT),
+#endif
+        samples{0}, head(0), fresh(0), dc(0), reference(REFERENCE_FLOOR) {}
+
+    void begin() {
+        for (int i = 0; i < FFT_SIZE; i++) { // Hann 窗
+            window[i] = lroundf((0.5f - 0.5f * cosf(2.0f * (float) M_PI * i / FFT_SIZE)) * 32767.0f);
+        }
+        float maxWeight = aWeighting(2500.0f); // A 计权在 2.5kHz 附近最大
+        for (int k = 0; k < FFT_SIZE / 2; k++) {
+            float f = (float) k * MIC_SAMPLE_RATE / FFT_SIZE;
+            weight[k] = lroundf(std::min(aWeighting(f) / maxWeight, 1.0f) * 32767.0f);
+        }
+        // 频段按对数间隔划分, 低频的频点较稀疏, 每个频段至少一个频点
+        float low = (float) MIC_MIN_FREQ * FFT_SIZE / MIC_SAMPLE_RATE;
+        float high = std::min((float) MIC_MAX_FREQ * FFT_SIZE / MIC_SAMPLE_RATE, FFT_SIZE / 2.0f);
+        edges[0] = std::max<int>(lroundf(low), 1);
+        for (int i = 1; i <= BANDS; i++) {
+            int edge = lroundf(low * powf(high / low, (float) i / BANDS));
+            edges[i] = constrain(std::max<int>(edge, edges[i - 1] + 1), 0, FFT_SIZE / 2);
+        }
+        for (int i = 1; i <= BANDS; i++) { // 频段太多时高频部分挤到了末尾, 没有频点的频段在 analyze 中沿用前一个频段
+            edges[i] = std::max(edges[i], edges[i - 1]);
+        }
+
+#if defined(ESP32)
+        i2s_config_t config = {};
+        config.mode = (i2s_mode_t) (I2S_MODE_MASTER | I2S_MODE_RX);
+        config.sample_rate = MIC_SAMPLE_RATE;
+        config.bits_per_sample = I2S_BITS_PER_SAMPLE_32BIT;
+        config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+        config.communication_format = I2S_COMM_FORMAT_STAND_I2S;
+        config.dma_buf_count = 4;
+        config.dma_buf_len = HOP;
+        i2s_pin_config_t pins = {};
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 4, 0)
+        pins.mck_io_num = I2S_PIN_NO_CHANGE;
+#endif
+        pins.bck_io_num = MIC_I2S_SCK;
+        pins.ws_io_num = MIC_I2S_WS;
+        pins.data_out_num = I2S_PIN_NO_CHANGE;
+        pins.data_in_num = MIC_I2S_SD;
+        i2s_driver_install(PORT, &config, 0, NULL);
+        i2s_set_pin(PORT, &pins);
+#elif defined(MIC_ADC_PIN)
+        adc.begin(MIC_SAMPLE_RATE);
+#else
+        i2s.setBCLK(MIC_I2S_SCK);
+        i2s.setDATA(MIC_I2S_SD);
+        i2s.setBitsPerSample(32);
+        i2s.begin(MIC_SAMPLE_RATE);
+#endif
+    }
+
+    /**
+     * @brief Read pending samples and analyze the latest window if enough new samples arrived
+     *
+     * @param volumes Q15 volume of each band, only written when returning true
+     * @return true if the volumes are updated
+     */
+    bool poll(uint16_t *volumes) {
+        read();
+        if (fresh < HOP) {
+            return false;
+        }
+        fresh = 0; // 积压的样本直接丢弃, 只分析最新的窗口
+        analyze(volumes);
+        return true;
+    }
+};
+
+#endif
+
+#endif // __MICROPHONE_HPP__
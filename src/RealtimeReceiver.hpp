@@ -0,0 +1,314 @@
+#ifndef __REALTIMERECEIVER_HPP__
+#define __REALTIMERECEIVER_HPP__
+
+#include "config.h"
+
+#ifdef ENABLE_REALTIME
+
+#include <atomic>
+#include <Arduino.h>
+#include <WiFiUdp.h>
+#include <FastLED.h>
+
+#include "FrameBuffer.hpp"
+#include "Light.hpp"
+
+// E1.31/Art-Net 中第一颗灯珠所在的 universe
+#ifndef REALTIME_UNIVERSE
+#define REALTIME_UNIVERSE 1
+#endif
+// 超过这么久没有收到数据就恢复原来的灯效 (ms)
+#ifndef REALTIME_TIMEOUT_MS
+#define REALTIME_TIMEOUT_MS 2500
+#endif
+
+#define DDP_PORT 4048
+#define E131_PORT 5568
+#define ARTNET_PORT 6454
+
+/**
+ * UDP 实时灯光输入, 支持 DDP, E1.31 (sACN) 和 Art-Net
+ *
+ * 每个 universe 按 RGB 顺序放 170 颗灯珠, 灯珠按接线顺序排列. 收到的数据先拼到三缓冲的后缓冲里,
+ * 一帧完整后 (DDP 的 push 标志, E1.31 的同步包, ArtSync, 或者收到最后一个 universe) 才整帧发布给渲染端.
+ * 每个 universe 单独检查序号, 丢弃乱序到达的旧包. 只接收单播, 不加入 E1.31 的组播地址
+ */
+template <typename LIGHT>
+class RealtimeReceiver {
+private:
+    static constexpr int LEDS_PER_UNIVERSE = 170;
+    static constexpr int UNIVERSE_COUNT = (LIGHT::led_count + LEDS_PER_UNIVERSE - 1) / LEDS_PER_UNIVERSE;
+    static constexpr int PACKET_SIZE = 1460;
+    static constexpr uint32_t ARTNET_SYNC_TIMEOUT_MS = 4000; // Art-Net 规定 4 秒没有 ArtSync 就恢复立即输出
+    static_assert(UNIVERSE_COUNT <= 32, "Too many universes");
+
+    WiFiUDP ddp;
+    WiFiUDP e131;
+    WiFiUDP artnet;
+    FrameBuffer<LIGHT::led_count> frames;
+    CRGB *last;         // 上一次发布的帧
+    CRGB *frame;        // 正在拼接的帧, 为空表示还没有开始
+    uint32_t received;  // 当前帧已收到的 universe
+    // 每个 universe 上一个包的序号, -1 表示未知
+    int16_t e131Sequence[UNIVERSE_COUNT];
+    int16_t artnetSequence[UNIVERSE_COUNT];
+    int16_t ddpSequence;
+    uint16_t syncAddress; // E1.31 的同步地址, 0 表示不等待同步包
+    uint32_t lastPacketTime;
+    uint32_t artnetSyncTime;
+    bool artnetSync;      // 发送端在使用 ArtSync
+    std::atomic<bool> active;
+    uint8_t packet[PACKET_SIZE];
+
+    // 与上一个包相比序号落后不超过 window 的视为旧包, E1.31 规定的窗口为 20
+    static bool isStale(int16_t &last, uint8_t seq, uint8_t mask, int window) {
+        if (last >= 0) {
+            int diff = (seq - last) & mask;
+            if (diff == 0 || diff > mask - window) {
+                return true;
+            }
+        }
+        last = seq;
+        return false;
+    }
+
+    CRGB* beginFrame() {
+        if (!frame) {
+            frame = frames.backBuffer();
+            if (last) { // 没有收到的部分保持上一帧的内容
+                memcpy(frame, last, sizeof(CRGB) * LIGHT::led_count);
+            } else {
+                fill_solid(frame, LIGHT::led_count, CRGB::Black);
+            }
+        }
+        return frame;
+    }
+
+    bool endFrame() {
+        if (!frame) {
+            return false;
+        }
+        frames.publish();
+        last = frame;
+        frame = nullptr;
+        received = 0;
+        active.store(true);
+        return true;
+    }
+
+    // 以字节为单位写入, DDP 的偏移不一定是 3 的倍数
+    void writeBytes(uint32_t offset, const uint8_t *data, uint32_t length) {
+        const uint32_t size = sizeof(CRGB) * LIGHT::led_count;
+        if (offset >= size) {
+            return;
+        }
+        if (length > size - offset) {
+            length = size - offset;
+        }
+        memcpy((uint8_t *) beginFrame() + offset, data, length);
+    }
+
+    // 返回 true 表示发布了新的一帧
+    bool writeUniverse(int universe, const uint8_t *data, int length, bool sync) {
+        int index = universe - REALTIME_UNIVERSE;
+        if (index < 0 || index >= UNIVERSE_COUNT) {
+            return false;
+        }
+        bool published = false;
+        // 同一个 universe 又来了说明发送端的 universe 比灯珠少, 上一帧已经结束
+        if (!sync && (received & (1U << index))) {
+            published = endFrame();
+        }
+        writeBytes(index * LEDS_PER_UNIVERSE * 3, data, std::min(length, LEDS_PER_UNIVERSE * 3));
+        received |= 1U << index;
+        if (!sync && index == UNIVERSE_COUNT - 1) {
+            published |= endFrame();
+        }
+        return published;
+    }
+
+    bool readDDP(int length) {
+        if (length < 10 || (packet[0] & 0xC0) != 0x40 || (packet[0] & 0x02)) { // 只处理 v1 的数据包
+            return false;
+        }
+        int header = packet[0] & 0x10 ? 14 : 10; // 带时间码
+        uint8_t id = packet[3];
+        if (id != 1 && id != 255) { // 只接收默认输出
+            return false;
+        }
+        if ((packet[1] & 0x0F) && isStale(ddpSequence, packet[1] & 0x0F, 0x0F, 4)) {
+            return false;
+        }
+        uint32_t offset = (uint32_t) packet[4] << 24 | (uint32_t) packet[5] << 16 | packet[6] << 8 | packet[7];
+        int size = packet[8] << 8 | packet[9];
+        if (header + size > length) {
+            return false;
+        }
+        if (size > 0) {
+            writeBytes(offset, packet + header, size);
+        }
+        return (packet[0] & 0x01) && endFrame();
+    }
+
+    bool readE131(int length) {
+        static const uint8_t ACN_ID[] = {0x41, 0x53, 0x43, 0x2d, 0x45, 0x31, 0x2e, 0x31, 0x37, 0x00, 0x00, 0x00};
+        if (length < 49 || memcmp(packet + 4, ACN_ID, sizeof(ACN_ID)) != 0) {
+            return false;
+        }
+        uint32_t rootVector = (uint32_t) packet[18] << 24 | (uint32_t) packet[19] << 16 | packet[20] << 8 | packet[21];
+        if (rootVector == 0x00000008) { // 扩展包, 只处理同步包, 忽略 universe 发现包
+            uint32_t framingVector = (uint32_t) packet[40] << 24 | (uint32_t) packet[41] << 16 | packet[42] << 8 | packet[43];
+            if (framingVector != 0x00000001) {
+                return false;
+            }
+            uint16_t address = packet[45] << 8 | packet[46];
+            return syncAddress != 0 && address == syncAddress && endFrame();
+        }
+        if (rootVector != 0x00000004 || length < 126 || packet[117] != 0x02 || packet[125] != 0) {
+            return false;
+        }
+        uint8_t options = packet[112];
+        if (options & 0x80) { // 预览数据不输出
+            return false;
+        }
+        if (options & 0x40) { // 发送端停止发送
+            lastPacketTime = millis() - REALTIME_TIMEOUT_MS;
+            return false;
+        }
+        int universe = packet[113] << 8 | packet[114];
+        int index = universe - REALTIME_UNIVERSE;
+        if (index >= 0 && index < UNIVERSE_COUNT && isStale(e131Sequence[index], packet[111], 0xFF, 20)) {
+            return false;
+        }
+        syncAddress = packet[109] << 8 | packet[110];
+        int count = (packet[123] << 8 | packet[124]) - 1;
+        count = std::min(count, length - 126);
+        return writeUniverse(universe, packet + 126, count, syncAddress != 0);
+    }
+
+    bool readArtNet(int length) {
+        if (length < 14 || memcmp(packet, "Art-Net", 8) != 0) {
+            return false;
+        }
+        uint16_t opcode = packet[8] | packet[9] << 8;
+        if (opcode == 0x5200) { // ArtSync
+            artnetSync = true;
+            artnetSyncTime = millis();
+            return endFrame();
+        }
+        if (opcode != 0x5000 || length < 18) { // 只处理 ArtDmx
+            return false;
+        }
+        if (artnetSync && millis() - artnetSyncTime > ARTNET_SYNC_TIMEOUT_MS) {
+            artnetSync = false;
+        }
+        int universe = packet[14] | (packet[15] & 0x7F) << 8;
+        int index = universe - REALTIME_UNIVERSE;
+        if (packet[12] && index >= 0 && index < UNIVERSE_COUNT && isStale(artnetSequence[index], packet[12], 0xFF, 20)) {
+            return false; // 序号为 0 表示发送端不使用序号
+        }
+        int count = std::min(packet[16] << 8 | packet[17], length - 18);
+        return writeUniverse(universe, packet + 18, count, artnetSync);
+    }
+
+    void reset() {
+        frame = nullptr;
+        received = 0;
+        for (int i = 0; i < UNIVERSE_COUNT; i++) {
+            e131Sequence[i] = -1;
+            artnetSequence[i] = -1;
+        }
+        ddpSequence = -1;
+        syncAddress = 0;
+        artnetSync = false;
+    }
+
+public:
+    RealtimeReceiver() : last(nullptr), lastPacketTime(0), artnetSyncTime(0), active(false) {
+        reset();
+    }
+
+    void begin() {
+        ddp.begin(DDP_PORT);
+        e131.begin(E131_PORT);
+        artnet.begin(ARTNET_PORT);
+    }
+
+    /**
+     * @brief Receive pending packets, only for the command side
+     *
+     * @return true if a new frame is published and the light should be woken up
+     */
+    bool poll() {
+        bool published = false;
+        int length;
+        while ((length = ddp.parsePacket()) > 0) {
+            lastPacketTime = millis();
+            published |= readDDP(ddp.read(packet, sizeof(packet)));
+        }
+        while ((length = e131.parsePacket()) > 0) {
+            lastPacketTime = millis();
+            published |= readE131(e131.read(packet, sizeof(packet)));
+        }
+        while ((length = artnet.parsePacket()) > 0) {
+            lastPacketTime = millis();
+            published |= readArtNet(artnet.read(packet, sizeof(packet)));
+        }
+        if (active.load() && millis() - lastPacketTime >= REALTIME_TIMEOUT_MS) {
+            active.store(false);
+            reset();
+        }
+        return published;
+    }
+
+    /**
+     * @brief Get the frame being assembled for another input such as serial, only for the command side
+     *
+     * @return uint8_t* RGB bytes of all leds, the parts not written keep the last frame
+     */
+    uint8_t* frameData() {
+        lastPacketTime = millis();
+        return (uint8_t *) beginFrame();
+    }
+
+    /**
+     * @brief Publish the frame written through frameData, only for the command side
+     *
+     * @return true if a new frame is published and the light should be woken up
+     */
+    bool publishFrame() {
+        lastPacketTime = millis();
+        return endFrame();
+    }
+
+    /**
+     * @brief Whether realtime frames are replacing the effect, safe for both sides
+     */
+    bool isActive() {
+        return active.load();
+    }
+
+    /**
+     * @brief Get the number of frames replaced before being rendered, safe for both sides
+     */
+    uint32_t getDropped() {
+        return frames.getDropped();
+    }
+
+    /**
+     * @brief Copy the latest realtime frame into light, only for the render side
+     *
+     * @return true if light is changed
+     */
+    bool update(Light &light) {
+        if (!frames.acquire()) {
+            return false;
+        }
+        memcpy(light.data(), frames.frontBuffer(), sizeof(CRGB) * light.count());
+        return true;
+    }
+};
+
+#endif
+
+#endif // __REALTIMERECEIVER_HPP__
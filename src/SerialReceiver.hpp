@@ -0,0 +1,252 @@
+#ifndef __SERIALRECEIVER_HPP__
+#define __SERIALRECEIVER_HPP__
+
+#include "config.h"
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+#include "RealtimeReceiver.hpp"
+
+// 串口波特率
+#ifndef SERIAL_BAUD
+#define SERIAL_BAUD 115200
+#endif
+// 一行命令的最大长度, 超出的行整行丢弃
+#ifndef SERIAL_LINE_SIZE
+#define SERIAL_LINE_SIZE 256
+#endif
+// 超过这么久没有新的字节, 未结束的命令当作一整行处理, 未收完的帧丢弃 (ms)
+#ifndef SERIAL_TIMEOUT_MS
+#define SERIAL_TIMEOUT_MS 1000
+#endif
+
+/**
+ * 非阻塞的串口接收, 支持文本命令以及 Adalight 和 TPM2 格式的灯光数据
+ *
+ * 每次 poll 只处理调用时已经收到的字节, 并在收完一行命令后返回, 不会等待后续数据.
+ * 行首收到 "Ada" 或 0xC9 时按二进制帧解析, 灯珠数据按 RGB 顺序直接读入实时输入的后缓冲, 收完一帧后发布,
+ * 与 UDP 实时输入共用同一个缓冲和超时. 没有开启 ENABLE_REALTIME 时只接收文本命令
+ */
+template <typename LIGHT>
+class SerialReceiver {
+public:
+    // 接收缓冲至少能放下一整帧, 避免处理较慢的命令时溢出
+    static constexpr size_t RX_BUFFER_SIZE = sizeof(CRGB) * LIGHT::led_count + 64 > 256 ?
+        sizeof(CRGB) * LIGHT::led_count + 64 : 256;
+
+private:
+    static constexpr uint32_t FRAME_SIZE = sizeof(CRGB) * LIGHT::led_count;
+    static constexpr uint8_t TPM2_START = 0xC9;
+    static constexpr uint8_t TPM2_DATA = 0xDA;
+    static constexpr uint8_t TPM2_END = 0x36;
+
+    enum State : uint8_t {
+        TEXT,        // 文本命令
+        SKIP_LINE,   // 超长的行, 丢弃到换行为止
+        ADA_HEADER,  // "Ada" 后的灯珠数量和校验和
+        TPM2_HEADER, // 0xC9 后的包类型和长度
+        PAYLOAD,     // 帧数据
+        TPM2_FOOTER, // 等待 0x36
+    };
+
+    Stream &stream;
+#ifdef ENABLE_REALTIME
+    RealtimeReceiver<LIGHT> &realtime;
+#endif
+    State state;
+    bool isTPM2;
+    bool isFrame;     // 数据是灯珠颜色, TPM2 的命令包只跳过
+    bool lineReady;
+    int length;       // 当前行或包头已收到的字节数
+    uint8_t header[3];
+    uint32_t offset;  // 帧数据已收到的字节数
+    uint32_t size;    // 帧数据的总字节数
+    uint32_t lastByteTime;
+    char line[SERIAL_LINE_SIZE];
+
+    void reset() {
+        state = TEXT;
+        length = 0;
+    }
+
+    void endLine() {
+        line[length] = '\0';
+        lineReady = length > 0;
+        length = 0;
+    }
+
+    void beginPayload() {
+        offset = 0;
+        state = size > 0 ? PAYLOAD : isTPM2 ? TPM2_FOOTER : TEXT;
+    }
+
+    // 返回 true 表示发布了新的一帧
+    bool endFrame() {
+        reset();
+#ifdef ENABLE_REALTIME
+        return isFrame && realtime.publishFrame();
+#else
+        return false;
+#endif
+    }
+
+    // 按块读取帧数据, 超出灯珠数量的部分丢弃
+    bool readPayload(int &available) {
+        uint32_t count = std::min<uint32_t>(available, size - offset);
+#ifdef ENABLE_REALTIME
+        if (isFrame && offset < FRAME_SIZE) {
+            uint32_t n = std::min(count, FRAME_SIZE - offset);
+            uint32_t read = stream.readBytes(realtime.frameData() + offset, n);
+            offset += read;
+            available -= read;
+            count -= read;
+            if (read < n) {
+                available = 0;
+                return false;
+            }
+        }
+#endif
+        for (; count > 0 && stream.read() >= 0; count--) {
+            offset++;
+            available--;
+        }
+        if (offset < size) {
+            return false;
+        }
+        if (isTPM2) {
+            state = TPM2_FOOTER;
+            return false;
+        }
+        return endFrame();
+    }
+
+    // 返回 true 表示发布了新的一帧
+    bool readByte(uint8_t c) {
+        switch (state) {
+        case TEXT:
+#ifdef ENABLE_REALTIME
+            if (length == 0 && c == TPM2_START) {
+                state = TPM2_HEADER;
+                return false;
+            }
+#endif
+            if (c == '\n') {
+                endLine();
+            } else if (length < SERIAL_LINE_SIZE - 1) {
+                line[length++] = c;
+#ifdef ENABLE_REALTIME
+                if (length == 3 && memcmp(line, "Ada", 3) == 0) {
+                    state = ADA_HEADER;
+                    length = 0;
+                }
+#endif
+            } else {
+                state = SKIP_LINE;
+            }
+            return false;
+        case SKIP_LINE:
+            if (c == '\n') {
+                reset();
+            }
+            return false;
+        case ADA_HEADER:
+            header[length++] = c;
+            if (length == 3) {
+                if ((header[0] ^ header[1] ^ 0x55) != header[2]) { // 校验失败, 重新寻找帧头
+                    reset();
+                    return false;
+                }
+                isTPM2 = false;
+                isFrame = true;
+                size = ((header[0] << 8 | header[1]) + 1) * 3;
+                beginPayload();
+            }
+            return false;
+        case TPM2_HEADER:
+            header[length++] = c;
+            if (length == 3) {
+                isTPM2 = true;
+                isFrame = header[0] == TPM2_DATA;
+                size = header[1] << 8 | header[2];
+                beginPayload();
+            }
+            return false;
+        case TPM2_FOOTER:
+            if (c == TPM2_END) {
+                return endFrame();
+            }
+            reset();
+            return false;
+        default:
+            return false;
+        }
+    }
+
+public:
+#ifdef ENABLE_REALTIME
+    SerialReceiver(Stream &stream, RealtimeReceiver<LIGHT> &realtime) :
+        stream(stream), realtime(realtime), lineReady(false), lastByteTime(0) {
+        reset();
+    }
+#else
+    SerialReceiver(Stream &stream) : stream(stream), lineReady(false), lastByteTime(0) {
+        reset();
+    }
+#endif
+
+    /**
+     * @brief Handle the bytes already received without blocking, stops after a complete line
+     *
+     * @return true if a new frame is published and the light should be woken up
+     */
+    bool poll() {
+        bool published = false;
+        lineReady = false;
+        int available = stream.available();
+        if (available > 0) {
+            lastByteTime = millis();
+        } else if ((state != TEXT || length > 0) && millis() - lastByteTime >= SERIAL_TIMEOUT_MS) {
+            if (state == TEXT) { // 与 readBytesUntil 一样, 没有换行符的命令超时后也执行
+                endLine();
+            } else {
+                reset();
+            }
+        }
+        while (available > 0 && !lineReady) {
+            if (state == PAYLOAD) {
+                published |= readPayload(available);
+            } else {
+                int c = stream.read();
+                available--;
+                if (c >= 0) {
+                    published |= readByte(c);
+                }
+            }
+        }
+        return published;
+    }
+
+    /**
+     * @brief Treat pending text as a complete line, e.g. at the end of input
+     *
+     * @return true if there is a line to handle
+     */
+    bool flushLine() {
+        if (state == TEXT && length > 0) {
+            endLine();
+        }
+        return lineReady;
+    }
+
+    /**
+     * @brief Get the line completed by the last poll
+     *
+     * @return char* the line without '\n', valid until the next poll, nullptr if there is none
+     */
+    char* getLine() {
+        return lineReady ? line : nullptr;
+    }
+};
+
+#endif // __SERIALRECEIVER_HPP__
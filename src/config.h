@@ -14,18 +14,32 @@
 /****************************** 硬件配置 ******************************/
 // LED 灯数据引脚
 #define LED_DATA_PIN 4 // D2 GPIO4
+// LED 灯使用 I2S DMA 输出(可选, 仅 ESP8266), 刷新灯珠时不再关中断阻塞 CPU
+// 数据引脚固定为 GPIO3 (RX), 将忽略 LED_DATA_PIN, 同时串口只能输出不能接收命令
+// #define LED_OUTPUT_DMA
 // LED 灯型号, 详见 FastLED 文档
 #define LED_TYPE WS2812B
 // LED 灯颜色顺序, 详见 FastLED 文档
 #define LED_COLOR_ORDER GRB
 // LED 灯颜色校正(可选), 详见 FastLED 文档
 // #define LED_CORRECTION 0xFFFFFF
-// LED 灯功率限制(可选), 详见 FastLED 文档
+// LED 灯伽马校正(可选), 使亮度变化更符合人眼感知, 常用 2.2~2.8
+// #define LED_GAMMA 2.2
+// LED 灯功率限制(可选), 按估算的电流压低最大亮度
 #define LED_MAX_POWER_MW 2500
-// LED 灯形态, 详见 Light.hpp
+// LED 灯供电电压和单颗灯珠红绿蓝通道满亮度时的电流(可选, 单位 mA), 用于估算功率, 默认按 WS2812B 计算
+// #define LED_VOLTAGE 5
+// #define LED_CURRENT_MA {16, 11, 15}
+// #define LED_IDLE_CURRENT_MA 1
+// LED 灯单颗灯珠的数据传输时长和每帧的锁存时长(可选, 单位微秒), 用于限制最大刷新率, 默认按 WS2812B 计算
+// #define LED_DATA_TIME_US 30
+// #define LED_RESET_TIME_US 280
+// LED 灯形态, 详见 Light.hpp (模拟器可通过 build_flags 覆盖)
+#ifndef LIGHT_TYPE
 #define LIGHT_TYPE LightStrip<30, false>
 // #define LIGHT_TYPE LightPanel<16, 16, SNAKE | HORIZONTAL>
 // #define LIGHT_TYPE LightDisc<CLOCKWISE | OUTSIDE_IN, 12, 6, 3>
+#endif
 
 /****************************** 软件配置 ******************************/
 // 开启调试模式
@@ -34,6 +48,44 @@
 #define NAME "RGBLight"
 // 多少毫秒不修改配置后保存配置, 0 为每次修改后立刻保存 (建议不要设为 0, 会大大缩短 Flash 寿命)
 #define CONFIG_SAVE_PERIOD (10 * 1000)
+// 接收 UDP 实时灯光数据 (DDP 4048, E1.31 5568, Art-Net 6454 端口), 可由 xLights, Hyperion 等软件控制, 超时后恢复原来的灯效
+#define ENABLE_REALTIME
+// E1.31/Art-Net 的起始 universe 和实时数据超时时长(可选, 单位毫秒)
+// #define REALTIME_UNIVERSE 1
+// #define REALTIME_TIMEOUT_MS 2500
+// 串口波特率(可选), 开启实时输入时串口还可以接收 Adalight 和 TPM2 数据, 灯珠较多时建议调高, 如 921600
+// #define SERIAL_BAUD 115200
+
+// 解码压缩动画时的读取缓冲大小(可选, 单位字节), 越大读取 Flash 的次数越少
+// #define ANIMATION_READ_SIZE 64
+// 动画预读的帧数(可选), 每帧占用 灯珠数 * 3 字节的静态内存, 文件读取偶尔较慢导致动画卡顿时可以调大
+// #define ANIMATION_PREFETCH_FRAMES 4
+// 关键帧动画的最大数据量(可选, 单位字节), 关键帧表需要整个读入同样大小的静态缓冲, ESP8266 上默认为 4096
+// #define ANIMATION_KEYFRAME_SIZE 16384
+// 从原始数据分区播放动画(可选, 仅 ESP32), 需要使用 partitions_anim.csv 分区表, 用 install 命令把动画安装到分区中
+// #define ENABLE_ANIM_PARTITION
+
+// 音乐律动的平滑参数(可选, 单位毫秒): 音量从 0 升到最大和降到 0 的时间, 峰值标记的停留时间和回落时间
+// #define MUSIC_ATTACK_MS 40
+// #define MUSIC_DECAY_MS 400
+// #define MUSIC_PEAK_HOLD_MS 500
+// #define MUSIC_PEAK_DECAY_MS 1000
+// 音乐律动的节拍检测灵敏度(可选, 通量超过近期平均值的多少个 1/16 倍算作节拍, 越大越不灵敏)和速度范围
+// #define BEAT_THRESHOLD 24
+// #define BEAT_MIN_BPM 60
+// #define BEAT_MAX_BPM 180
+
+// 使用麦克风采集音乐律动的音量(可选, 仅 ESP32 和 RP2040), 收到网页端发来的音量时暂停使用
+// #define ENABLE_MICROPHONE
+// I2S 数字麦克风 (如 INMP441) 的引脚, RP2040 上 WS 固定为 SCK + 1
+// #define MIC_I2S_SCK 26
+// #define MIC_I2S_WS 27
+// #define MIC_I2S_SD 28
+// RP2040 上改用模拟麦克风 (如 MAX9814) 时的 ADC 引脚
+// #define MIC_ADC_PIN 26
+
+// 统计实时输入从收到到灯珠刷新完成的延迟(可选), 可用 latency 命令查看, 约占用 2.5KB 内存
+// #define ENABLE_LATENCY_TRACE
 
 // 恭喜你, 已经完成了所有配置, 其余配置可通过网页或小程序修改, 详见 README.md
 
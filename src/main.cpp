@@ -11,6 +11,9 @@
 #include <functional>
 #include <Arduino.h>
 #include <Ticker.h>
+#if defined(PICO_RP2040)
+#include <hardware/irq.h>
+#endif
 #include <LittleFS.h>
 #if defined(ESP8266) || defined(PICO_RP2040)
 #include <Updater.h>
@@ -42,29 +45,52 @@ typedef ESP8266WebServer WebServer;
 #include <GDBStub.h>
 #endif
 
-#include "CommandHandler.hpp"
-#include "Light.hpp"
-#include "LightEffect.hpp"
+#include "FrameBuffer.hpp"
+#include "I2SDmaController.hpp"
+#include "LightControl.hpp"
 #include "utils.h"
 
 #define MIME_TYPE(t) (mime::mimeTable[mime::type::t].mimeType)
 
-typedef std::function<Effect*(int argc, const char *argv[])> CreateEffectFunc;
-
 const char *product_name = "rgblight";
 const char *model_name = MODEL;
 const char *version = VERSION;
 const uint32_t version_code = VERSION_CODE;
 
-CreateEffectFunc effectFactories[EFFECT_TYPE_COUNT];
+#if defined(ESP32)
+TaskHandle_t renderTask;
+#elif defined(PICO_RP2040)
+Ticker timer;
+uint renderIrq;
+#else
 Ticker timer;
-LIGHT_TYPE light;
-Effect *lightEffect;
+Ticker wakeTimer;
+#endif
+bool powerSaving;
+#ifdef LED_OUTPUT_DMA
+I2SDmaController<LIGHT_TYPE::led_count, LED_COLOR_ORDER> dmaController;
+#endif
+#ifndef DUAL_CORE_OUTPUT
+CRGB outputLeds[LIGHT_TYPE::led_count]; // 经过颜色处理后输出到灯珠的一帧
+#endif
+#ifdef DUAL_CORE_OUTPUT
+FrameBuffer<LIGHT_TYPE::led_count> frameBuffer;
+CLEDController *ledController;
+#if defined(ESP32)
+TaskHandle_t outputTask;
+#endif
+#endif
 DNSServer dnsServer;
 WebServer webServer(80);
 WebSocketsServer wsServer(81);
+// 推送给所有 WebSocket 客户端的状态变化, 在 loop 中合并后以 "STATE,{...}" 发送, 见 StateChange
+uint8_t stateChanges;
+uint32_t lastStateTime;
+// 各 WebSocket 客户端订阅的状态推送间隔 (ms), 0 表示未订阅
+uint16_t telemetryInterval[WEBSOCKETS_SERVER_CLIENT_MAX];
+uint32_t telemetryTime[WEBSOCKETS_SERVER_CLIENT_MAX];
 
-struct Config {
+struct Config : LightConfig {
     time_t lastModifyTime;
     bool isDirty;
 
@@ -72,21 +98,22 @@ struct Config {
     String ssid;          // WIFI 名称
     String password;      // WIFI 密码
     String hostname;      // 主机名
-    uint16_t refreshRate; // 刷新率, 默认 60Hz
-    uint8_t brightness;   // 亮度, 默认 63
-    uint32_t temperature; // 色温, 默认 6600K
 } config;
 
-// For LightEffect
-const uint16_t &fps = config.refreshRate;
-
-void updateLight();
-
 void markDirty() {
     config.lastModifyTime = millis();
     config.isDirty = true;
 }
 
+void notifyChange(uint8_t change) {
+    stateChanges |= change;
+}
+
+void settingsChanged(uint8_t change) {
+    markDirty();
+    notifyChange(change);
+}
+
 void serializeSettings(JsonDocument &doc, bool includeWifi = true) {
     doc["name"] = config.name;
     if (includeWifi) { // 获取 wifi 信息时不应包含密码
@@ -141,12 +168,12 @@ void readSettings() {
     config.refreshRate = doc["refreshRate"] | 60;
     config.brightness = doc["brightness"] | 63;
     config.temperature = doc["temperature"] | 6600;
-    lightEffect = Effect::readFromJSON<LIGHT_TYPE>(doc);
+    lightEffect.publish(Effect::readFromJSON<LIGHT_TYPE>(lightEffect.allocate(), doc));
+
+    colorPipeline.setBrightness(config.brightness);
+    colorPipeline.setTemperature(config.temperature);
+    startFrameClock(config.refreshRate);
 
-    FastLED.setBrightness(config.brightness);
-    FastLED.setTemperature(CRGB(kelvin2rgb(config.temperature)));
-    timer.attach_ms(1000 / config.refreshRate, updateLight);
-    
     if (shouldSave) {
         saveSettings();
     }
@@ -234,94 +261,224 @@ bool startHotspot() {
     return result;
 }
 
-void updateLight() {
-    if (lightEffect->update(light, 0)) {
-        FastLED.show();
+// 把 light 中的当前帧经过颜色处理后交给输出, 双核芯片上由另一个核心刷新灯珠
+void showLight() {
+#ifdef DUAL_CORE_OUTPUT
+    if (colorPipeline.apply(light.data(), frameBuffer.backBuffer(), light.count())) {
+        forceShow = true; // 功率限制正在恢复, 继续刷新
+    }
+#ifdef ENABLE_LATENCY_TRACE
+    latency.endRender();
+#endif
+    frameBuffer.publish();
+#if defined(ESP32)
+    xTaskNotifyGive(outputTask);
+#elif defined(PICO_RP2040)
+    __sev();
+#endif
+#else
+    if (colorPipeline.apply(light.data(), outputLeds, light.count())) {
+        forceShow = true; // 功率限制正在恢复, 继续刷新
+    }
+#ifdef ENABLE_LATENCY_TRACE
+    latency.endRender();
+#endif
+    FastLED.show();
+#ifdef ENABLE_LATENCY_TRACE
+    latency.shown();
+#endif
+#endif
+}
+
+#ifdef DUAL_CORE_OUTPUT
+void outputLight() {
+    ledController->setLeds(frameBuffer.frontBuffer(), light.count());
+    FastLED.show();
+#ifdef ENABLE_LATENCY_TRACE
+    latency.shown();
+#endif
+}
+
+#if defined(ESP32)
+// 渲染任务运行在 core 0, 输出任务放在另一个核心上
+void outputLoop(void *arg) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (frameBuffer.acquire()) {
+            outputLight();
+        }
+    }
+}
+#elif defined(PICO_RP2040)
+void loop1() {
+    if (frameBuffer.acquire()) {
+        outputLight();
+    } else {
+        __wfe(); // 等待 core 0 发布新帧
+    }
+}
+#endif
+#endif
+
+// 渲染端只有一个执行上下文, 只有它自己设置下一次运行的时间, 命令端通过 signalLight 通知它提前运行
+#if defined(ESP32)
+// 渲染任务按 updateLight 返回的时间等待, 向上取整避免提前醒来, 命令端用任务通知唤醒
+void renderLoop(void *arg) {
+    uint32_t wait = NO_UPDATE; // 等到 readSettings 启动帧时钟
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, wait == NO_UPDATE ? portMAX_DELAY :
+            std::max<TickType_t>(pdMS_TO_TICKS((wait + 999) / 1000), 1));
+        wait = updateLight();
+    }
+}
+
+void signalLight() {
+    xTaskNotifyGive(renderTask);
+}
+#elif defined(PICO_RP2040)
+// 渲染在 core 0 的软件中断中进行, 定时器回调和命令端都只是触发这个中断, 定时器只在中断中设置
+void renderLight() {
+    uint32_t wait = updateLight();
+    if (wait != NO_UPDATE) {
+        timer.once_ms(std::max<uint32_t>((wait + 999) / 1000, 1), signalLight);
+    }
+}
+
+void signalLight() {
+    irq_set_pending(renderIrq);
+}
+#else
+// ESP8266 上定时器回调和 loop 不会同时运行, 命令端用另一个定时器把唤醒投递到定时器回调中, 两个定时器各自只在一处设置
+void renderLight() {
+    uint32_t wait = updateLight();
+    if (wait != NO_UPDATE) {
+        timer.once_ms(std::max<uint32_t>((wait + 999) / 1000, 1), renderLight);
+    }
+}
+
+void signalLight() {
+    wakeTimer.once_ms(1, renderLight);
+}
+#endif
+
+// 灯效静止时允许 WIFI 进入 Light-sleep, ESP32 默认已开启 Modem-sleep
+void updatePowerSave() {
+    bool idle = lightState == LIGHT_IDLE && WiFi.getMode() == WIFI_STA;
+#ifdef ENABLE_REALTIME
+    idle = idle && !realtime.isActive(); // 实时数据随时会到, 睡眠会增加延迟
+#endif
+#ifdef ENABLE_MICROPHONE
+    idle = idle && lightEffect->type() != MUSIC; // 需要持续读取麦克风
+#endif
+    if (idle == powerSaving) {
+        return;
+    }
+    powerSaving = idle;
+#if defined(ESP8266)
+    WiFi.setSleepMode(idle ? WIFI_LIGHT_SLEEP : WIFI_MODEM_SLEEP);
+#endif
+}
+
+// 状态变化合并后推送给所有客户端, 拖动滑条时最多每 100ms 推送一次
+void broadcastState() {
+    if (stateChanges == 0 || millis() - lastStateTime < 100) {
+        return;
+    }
+    lastStateTime = millis();
+    uint8_t changes = stateChanges;
+    stateChanges = 0;
+    if (wsServer.connectedClients() == 0) {
+        return;
+    }
+    StaticJsonDocument<512> doc;
+    if (changes & CHANGE_NAME) {
+        doc["name"] = config.name;
+        doc["hostname"] = config.hostname;
+    }
+    if (changes & CHANGE_MODE) {
+        lightEffect->writeToJSON(doc);
     }
+    if (changes & CHANGE_BRIGHTNESS) {
+        doc["brightness"] = config.brightness;
+    }
+    if (changes & CHANGE_TEMPERATURE) {
+        doc["temperature"] = config.temperature;
+    }
+    if (changes & CHANGE_REFRESH_RATE) {
+        doc["refreshRate"] = config.refreshRate;
+    }
+    char str[384] = "STATE,";
+    size_t length = 6 + serializeJson(doc, str + 6, sizeof(str) - 6);
+    wsServer.broadcastTXT(str, length);
 }
 
-void handleCommand(SenderFunc sender, char *line) {
+// 只包含会变化的运行状态, 直接格式化, 同一次循环中到期的客户端共用一条消息
+size_t writeTelemetry(char *str, size_t size) {
+#if defined(ESP8266) || defined(ESP32)
+    uint32_t freeHeap = ESP.getFreeHeap();
+#elif defined(PICO_RP2040)
+    uint32_t freeHeap = rp2040.getFreeHeap();
+#endif
+    uint16_t bpm = 0;
+    uint32_t dropped = CustomEffect<LIGHT_TYPE>::getDropped();
     if (lightEffect->type() == MUSIC) {
-        if (!isalpha(line[0])) { // 假定所有命令都是字母开头且以字母开头的一定是命令
-            char *p = line;
-            for (int i = 0; ; i++) {
-                char *q = strchr(p, ',');
-                if (q) {
-                    *q = '\0';
-                }
-                float value = atof(p);
-                ((MusicEffect<LIGHT_TYPE> *) lightEffect)->setVolume(i, value);
-                if (!q) break;
-                p = q + 1;
-            }
-            return;
+        bpm = ((MusicEffect<LIGHT_TYPE> *) lightEffect.get())->getBPM();
+        dropped += ((MusicEffect<LIGHT_TYPE> *) lightEffect.get())->getDropped();
+    }
+    bool live = false;
+#ifdef ENABLE_REALTIME
+    live = realtime.isActive();
+    dropped += realtime.getDropped();
+#endif
+    int length = snprintf_P(str, size,
+        PSTR("TELEMETRY,{\"fps\":%u,\"skippedFrames\":%u,\"current\":%u,\"freeHeap\":%u,\"RSSI\":%d,\"realtime\":%s,\"bpm\":%u,\"dropped\":%u}"),
+        frameRate.load(std::memory_order_relaxed), (unsigned) frameClock.getSkippedFrames(), (unsigned) colorPipeline.getCurrent(),
+        (unsigned) freeHeap, (int) WiFi.RSSI(), live ? "true" : "false", bpm, (unsigned) dropped);
+    return std::min<size_t>(length, size - 1);
+}
+
+void sendTelemetry() {
+    char str[192];
+    size_t length = 0;
+    for (uint8_t num = 0; num < WEBSOCKETS_SERVER_CLIENT_MAX; num++) {
+        if (telemetryInterval[num] == 0 || millis() - telemetryTime[num] < telemetryInterval[num]) {
+            continue;
         }
-    } else if (lightEffect->type() == CUSTOM) {
-        if (!isalpha(line[0])) {
-            uint32_t color = str2hex(line);
-            int &index = ((CustomEffect<LIGHT_TYPE> *) lightEffect)->getIndex();
-            light.data()[index++] = CRGB(color);
-            if (index >= light.count()) {
-                index = 0;
-            }
-            return;
+        telemetryTime[num] = millis();
+        if (length == 0) {
+            length = writeTelemetry(str, sizeof(str));
         }
+        wsServer.sendTXT(num, str, length);
     }
-    cmdHandler.parseCommand(sender, line);
 }
 
-void initEffects() {
-    effectFactories[CONSTANT] = [](int argc, const char *argv[]) {
-        uint32_t color = argc > 0 ? str2hex(argv[0]) : DEFAULT_COLOR;
-        return new ConstantEffect<LIGHT_TYPE>(color);
-    };
-    effectFactories[BLINK] = [](int argc, const char *argv[]) {
-        uint32_t color = argc > 0 ? str2hex(argv[0]) : DEFAULT_COLOR;
-        float lastTime = argc > 1 ? atof(argv[1]) : 1.0;
-        float interval = argc > 2 ? atof(argv[2]) : 1.0;
-        return new BlinkEffect<LIGHT_TYPE>(color, lastTime, interval);
-    };
-    effectFactories[BREATH] = [](int argc, const char *argv[]) {
-        uint32_t color = argc > 0 ? str2hex(argv[0]) : DEFAULT_COLOR;
-        float lastTime = argc > 1 ? atof(argv[1]) : 1.0;
-        float interval = argc > 2 ? atof(argv[2]) : 0.5;
-        return new BreathEffect<LIGHT_TYPE>(color, lastTime, interval);
-    };
-    effectFactories[CHASE] = [](int argc, const char *argv[]) {
-        uint32_t color    = argc > 0 ? str2hex(argv[0]) : DEFAULT_COLOR;
-        uint8_t direction = argc > 1 ? atoi(argv[1]) : 0;
-        float lastTime    = argc > 2 ? atof(argv[2]) : 0.2;
-        return new ChaseEffect<LIGHT_TYPE>(color, direction, lastTime);
-    };
-    effectFactories[RAINBOW] = [](int argc, const char *argv[]) {
-        int8_t delta = argc > 0 ? atoi(argv[0]) : 1;
-        return new RainbowEffect<LIGHT_TYPE>(delta);
-    };
-    effectFactories[STREAM] = [](int argc, const char *argv[]) {
-        uint8_t direction = argc > 0 ? atoi(argv[0]) : 0;
-        int8_t delta      = argc > 1 ? atoi(argv[1]) : 1;
-        return new StreamEffect<LIGHT_TYPE>(direction, delta);
-    };
-    effectFactories[ANIMATION] = [](int argc, const char *argv[]) {
-        const char *name = argc > 0 ? argv[0] : "";
-        return new AnimationEffect<LIGHT_TYPE>(name);
-    };
-    effectFactories[MUSIC] = [](int argc, const char *argv[]) {
-        uint8_t mode = argc > 0 ? atoi(argv[0]) : 1;
-        return new MusicEffect<LIGHT_TYPE>(mode);
-    };
-    effectFactories[CUSTOM] = [](int argc, const char *argv[]) {
-        return new CustomEffect<LIGHT_TYPE>();
-    };
+// 串口每次循环只处理已收到的数据和最多一行命令, Adalight/TPM2 帧直接进入实时输入
+void handleSerial() {
+    char *line = pollSerial();
+    if (line) {
+#ifdef ENABLE_DEBUG
+        Serial.printf("Received data from com: %s\n", line);
+#endif
+        handleCommand([](const char *msg) {
+            Serial.println(msg);
+        }, line);
+    }
 }
 
-void registerCommands() {
-    cmdHandler.setDefaultHandler([](SenderFunc sender, int argc, char *argv[]) {
-        sender("Unknown command. type 'help' for helps.");
-    });
-    cmdHandler.registerCommand("help", "Show command helps", [](SenderFunc sender, int argc, char *argv[]) {
-        cmdHandler.printHelp(sender);
+#ifdef ENABLE_LATENCY_TRACE
+void handleLatency() {
+    latency.poll([](int8_t client, const char *msg) {
+        if (client == LatencyTracker::SERIAL_REPLY) {
+            Serial.println(msg);
+        } else {
+            wsServer.sendTXT(client, msg, strlen(msg));
+        }
     });
+}
+#endif
+
+void registerCommands() {
+    registerLightCommands(config);
 #ifdef ENABLE_DEBUG
     cmdHandler.registerCommand("debug", "Show debug info", [](SenderFunc sender, int argc, char *argv[]) {
         printSystemInfo();
@@ -353,7 +510,7 @@ void registerCommands() {
         sender(str.c_str());
     });
     cmdHandler.registerCommand("status", "Show status", [](SenderFunc sender, int argc, char *argv[]) {
-        StaticJsonDocument<256> doc;
+        StaticJsonDocument<512> doc;
 #if defined(ESP8266)
         doc["vcc"] = ESP.getVcc() / 1000.0;
         doc["resetReason"] = ESP.getResetReason();
@@ -372,6 +529,7 @@ void registerCommands() {
         doc["freePsram"] = rp2040.getFreePSRAMHeap();
 #endif
         doc["RSSI"] = WiFi.RSSI();
+        writeLightStatus(doc);
 #if defined(ESP8266) || defined(PICO_RP2040)
         FSInfo fs_info;
         LittleFS.info(fs_info);
@@ -385,6 +543,55 @@ void registerCommands() {
         serializeJson(doc, str);
         sender(str.c_str());
     });
+#if defined(ESP32) && defined(ENABLE_ANIM_PARTITION)
+    cmdHandler.registerCommand("install", "Install animation into partition: [name|clear]", [](SenderFunc sender, int argc, char *argv[]) {
+        AnimationPartition &partition = AnimationPartition::instance();
+        if (argc <= 1) {
+            DynamicJsonDocument doc(2048);
+            partition.writeToJSON(doc);
+            String str;
+            serializeJson(doc, str);
+            sender(str.c_str());
+            return;
+        }
+        bool clear = strcmp(argv[1], "clear") == 0;
+        if (!clear && !AnimationPartition::isValidName(argv[1])) {
+            sender("INVAILD");
+            return;
+        }
+        if (!partition || lightEffect->type() == ANIMATION) { // 写入时不能从分区中播放
+            sender("ERR");
+            return;
+        }
+        // 命令都在 loop 中依次处理, 写完之前不会切换到动画, 只需等渲染端用完已被替换的旧动画并回收
+        uint32_t start = millis();
+        while (!lightEffect.collect()) {
+            if (millis() - start > 100) {
+                sender("ERR");
+                return;
+            }
+            delay(1);
+        }
+        bool ok;
+        if (clear) {
+            ok = partition.clear();
+        } else {
+            File file = LittleFS.open(String("/animations/") + argv[1], "r");
+            ok = file && !file.isDirectory() && partition.install(argv[1], file);
+        }
+        sender(ok ? "OK" : "ERR");
+    });
+#endif
+    cmdHandler.registerCommand("subscribe", "Push status every N ms over WebSocket, 0 to stop", [](SenderFunc sender, int argc, char *argv[]) {
+        int interval = argc > 1 ? atoi(argv[1]) : -1;
+        if (commandClient < 0 || (interval != 0 && (interval < 100 || interval > 60000))) {
+            sender("INVAILD");
+            return;
+        }
+        telemetryInterval[commandClient] = interval;
+        telemetryTime[commandClient] = millis() - interval; // 立即推送一次
+        sender("OK");
+    });
     cmdHandler.registerCommand("config", "Get config", [](SenderFunc sender, int argc, char *argv[]) {
         StaticJsonDocument<1024> doc;
         if (WiFi.getMode() == WIFI_AP) {
@@ -461,86 +668,13 @@ void registerCommands() {
         }
         config.name = argv[1];
         if (argc > 2) config.hostname = argv[2];
-        markDirty();
+        settingsChanged(CHANGE_NAME);
         sender("OK");
         if (WiFi.getMode() == WIFI_AP) {
             startHotspot();
         }
         setWifiMode(WiFi.getMode());
     });
-    cmdHandler.registerCommand("mode", "Get/set light mode", [](SenderFunc sender, int argc, char *argv[]) {
-        if (argc <= 1) {
-            String str = effect2str(lightEffect->type());
-            sender(str.c_str());
-            return;
-        }
-        EffectType type = str2effect(argv[1]);
-        if (type >= CONSTANT && type < EFFECT_TYPE_COUNT) {
-            delete lightEffect;
-            lightEffect = effectFactories[type](argc - 2, (const char **) argv + 2);
-            markDirty();
-            sender("OK");
-        } else {
-            sender("INVAILD");
-        }
-    });
-    cmdHandler.registerCommand("brightness", "Get/set brightness", [](SenderFunc sender, int argc, char *argv[]) {
-        if (argc <= 1) {
-            String str = String(config.brightness);
-            sender(str.c_str());
-            return;
-        }
-        int brightness = atoi(argv[1]);
-        if (brightness >= 0 && brightness <= 255) {
-            if (config.brightness != brightness) {
-                FastLED.setBrightness(brightness);
-                FastLED.show();
-                config.brightness = (uint8_t) brightness;
-                markDirty();
-            }
-            sender("OK");
-        } else {
-            sender("INVAILD");
-        }
-    });
-    cmdHandler.registerCommand("temperature", "Get/set temperature", [](SenderFunc sender, int argc, char *argv[]) {
-        if (argc <= 1) {
-            String str = String(config.temperature) + String('K');
-            sender(str.c_str());
-            return;
-        }
-        int temperature = atoi(argv[1]);
-        if (temperature >= 0) {
-            if (config.temperature != temperature) {
-                FastLED.setTemperature(CRGB(kelvin2rgb(temperature)));
-                FastLED.show();
-                config.temperature = (uint32_t) temperature;
-                markDirty();
-            }
-            sender("OK");
-        } else {
-            sender("INVAILD");
-        }
-    });
-    cmdHandler.registerCommand("fps", "Get/set refresh rate", [](SenderFunc sender, int argc, char *argv[]) {
-        if (argc <= 1) {
-            String str = String(config.refreshRate);
-            sender(str.c_str());
-            return;
-        }
-        int rate = atoi(argv[1]);
-        if (rate > 0 && rate <= 400) {
-            if (config.refreshRate != rate) {
-                if (timer.active()) timer.detach();
-                timer.attach_ms(1000 / rate, updateLight);
-                config.refreshRate = (uint16_t) rate;
-                markDirty();
-            }
-            sender("OK");
-        } else {
-            sender("INVAILD");
-        }
-    });
 }
 
 #ifdef ESP8266
@@ -548,21 +682,43 @@ ADC_MODE(ADC_VCC); // Enable ESP.getVcc()
 #endif
 
 void setup() {
-    FastLED.addLeds<LED_TYPE, LED_DATA_PIN, LED_COLOR_ORDER>(light.data(), light.count());
-#ifdef LED_CORRECTION
-    FastLED.setCorrection(CRGB(LED_CORRECTION));
+#if defined(LED_OUTPUT_DMA)
+    FastLED.addLeds(&dmaController, outputLeds, light.count());
+#elif defined(DUAL_CORE_OUTPUT)
+    ledController = &FastLED.addLeds<LED_TYPE, LED_DATA_PIN, LED_COLOR_ORDER>(frameBuffer.frontBuffer(), light.count());
+#else
+    FastLED.addLeds<LED_TYPE, LED_DATA_PIN, LED_COLOR_ORDER>(outputLeds, light.count());
 #endif
-#ifdef LED_MAX_POWER_MW
-    // TODO FastLED 的功率限制是在刷新灯珠的时候做的, 但我需要限制的是最大亮度
-    FastLED.setMaxPowerInMilliWatts(LED_MAX_POWER_MW);
+    // 亮度, 色温, 颜色校正和功率限制都由 colorPipeline 处理, FastLED 保持默认的不做调整
+#ifdef LED_CORRECTION
+    colorPipeline.setCorrection(CRGB(LED_CORRECTION));
 #endif
     FastLED.clear(true);
+#if defined(DUAL_CORE_OUTPUT) && defined(ESP32)
+    xTaskCreatePinnedToCore(outputLoop, "ledOutput", 4096, NULL, 2, &outputTask, ARDUINO_RUNNING_CORE);
+#endif
+#if defined(ESP32)
+    // 与 esp_timer 任务相同的优先级, 避免被网络任务拖慢
+    xTaskCreatePinnedToCore(renderLoop, "lightRender", 4096, NULL, configMAX_PRIORITIES - 3, &renderTask, 0);
+#elif defined(PICO_RP2040)
+    renderIrq = user_irq_claim_unused(true);
+    irq_set_exclusive_handler(renderIrq, renderLight);
+    irq_set_enabled(renderIrq, true);
+#endif
 
-    Serial.begin(115200);
+#ifdef LED_OUTPUT_DMA
+    Serial.begin(SERIAL_BAUD, SERIAL_8N1, SERIAL_TX_ONLY); // RX 引脚已被 I2S 占用
+#else
+#if defined(ESP8266) || defined(ESP32)
+    Serial.setRxBufferSize(SerialReceiver<LIGHT_TYPE>::RX_BUFFER_SIZE);
+#endif
+    Serial.begin(SERIAL_BAUD);
+#endif
     Serial.println();
     Serial.print(F("RGB Light, version: "));
     Serial.println(version);
     Serial.println(F("Made by QingChenW with love"));
+    colorPipeline.checkPowerLimit(light.count());
 #ifdef ENABLE_DEBUG
     gdbstub_init(); // XXX 在 esp8266-arduino 3.0+ 上疑似会严重干扰 LED 时序
 #endif
@@ -571,6 +727,9 @@ void setup() {
     LittleFS.begin();
 #elif defined(ESP32)
     LittleFS.begin(true); // XXX Arduino IDE 2.0 目前无 ESP32 上传文件系统插件, 所以默认格式化, 然后用 OTA 功能上传
+#ifdef ENABLE_ANIM_PARTITION
+    AnimationPartition::instance().begin();
+#endif
 #endif
     readSettings();
 
@@ -585,7 +744,6 @@ void setup() {
         setWifiMode(WIFI_AP);
     }
 
-    initEffects();
     registerCommands();
 
     Serial.println(F("Start HTTP server"));
@@ -751,11 +909,13 @@ void setup() {
     wsServer.onEvent([](uint8_t num, WStype_t type, uint8_t *payload, size_t length) {
         switch (type) {
             case WStype_CONNECTED: { // payload is "/"
+                telemetryInterval[num] = 0;
                 IPAddress ip = wsServer.remoteIP(num);
                 Serial.printf_P(PSTR("Client %u connected from %s\n"), num, ip.toString().c_str());
                 break;
             }
             case WStype_DISCONNECTED: {
+                telemetryInterval[num] = 0;
                 Serial.printf_P(PSTR("Client %u disconnected\n"), num);
                 break;
             }
@@ -765,42 +925,62 @@ void setup() {
 #ifdef ENABLE_DEBUG
                     Serial.printf("Received message from ws%u: %s\n", num, str);
 #endif
+                    commandClient = num;
                     handleCommand([num](const char *msg) {
                         wsServer.sendTXT(num, msg, strlen(msg));
                     }, str);
+                    commandClient = -1;
                     yield();
                 }
                 break;
             }
+            case WStype_BIN: {
+                commandClient = num;
+                handleBinary([num](const char *msg) {
+                    wsServer.sendTXT(num, msg, strlen(msg));
+                }, payload, length);
+                commandClient = -1;
+                break;
+            }
         }
     });
     wsServer.begin();
+#ifdef ENABLE_REALTIME
+    realtime.begin();
+#endif
+#ifdef ENABLE_MICROPHONE
+    microphone.begin();
+#endif
 }
 
 void loop() {
     if (config.isDirty && millis() - config.lastModifyTime >= CONFIG_SAVE_PERIOD) {
         saveSettings();
     }
-    while (Serial.available() > 0) {
-        char buffer[128];
-        size_t len = Serial.readBytesUntil('\n', buffer, sizeof(buffer) - 1);
-        if (len > 0) {
-            buffer[len] = '\0';
-#ifdef ENABLE_DEBUG
-            Serial.printf("Received data from com: %s\n", buffer);
-#endif
-            handleCommand([](const char *msg) {
-                Serial.println(msg);
-            }, buffer);
-            yield();
-        }
-    }
+    handleSerial();
     dnsServer.processNextRequest();
     webServer.handleClient();
     wsServer.loop();
+    broadcastState();
+    sendTelemetry();
+#ifdef ENABLE_LATENCY_TRACE
+    handleLatency();
+#endif
 #if defined(ESP8266) || defined(PICO_RP2040)
     MDNS.update();
 #endif
+#ifdef ENABLE_REALTIME
+    handleRealtime();
+#endif
+#ifdef ENABLE_MICROPHONE
+    handleMicrophone();
+#endif
+    handleAnimation();
+    lightEffect.collect();
+    updatePowerSave();
+    if (powerSaving) {
+        delay(10); // 让出 CPU, 系统空闲时才能进入睡眠
+    }
 }
 
 #ifdef ENABLE_DEBUG
@@ -23,39 +23,76 @@ void hex2str(uint32_t hex, char *str) {
     sprintf(str, "#%06x", hex);
 }
 
+// 色温曲线, 由 Tanner Helland 的拟合公式按 100K 间隔生成, 运行时只需查表和线性插值
 // From http://www.tannerhelland.com/4435/convert-temperature-rgb-algorithm-code/
+#define KELVIN_MIN 1000u
+#define KELVIN_MAX 40000u
+#define KELVIN_STEP 100u
+static const uint8_t KELVIN_TABLE[][3] PROGMEM = {
+    {255, 67, 0}, {255, 77, 0}, {255, 86, 0}, {255, 94, 0}, {255, 101, 0}, {255, 108, 0}, {255, 114, 0}, {255, 120, 0},
+    {255, 126, 0}, {255, 131, 0}, {255, 136, 13}, {255, 141, 27}, {255, 146, 39}, {255, 150, 50}, {255, 155, 60}, {255, 159, 70},
+    {255, 162, 79}, {255, 166, 87}, {255, 170, 95}, {255, 173, 102}, {255, 177, 109}, {255, 180, 116}, {255, 183, 123}, {255, 186, 129},
+    {255, 189, 135}, {255, 192, 140}, {255, 195, 146}, {255, 198, 151}, {255, 200, 156}, {255, 203, 161}, {255, 205, 166}, {255, 208, 170},
+    {255, 210, 175}, {255, 213, 179}, {255, 215, 183}, {255, 217, 187}, {255, 219, 191}, {255, 221, 195}, {255, 223, 198}, {255, 226, 202},
+    {255, 228, 205}, {255, 229, 209}, {255, 231, 212}, {255, 233, 215}, {255, 235, 219}, {255, 237, 222}, {255, 239, 225}, {255, 241, 228},
+    {255, 242, 231}, {255, 244, 234}, {255, 246, 236}, {255, 247, 239}, {255, 249, 242}, {255, 251, 244}, {255, 252, 247}, {255, 254, 250},
+    {255, 255, 255}, {254, 248, 255}, {249, 246, 255}, {246, 244, 255}, {242, 242, 255}, {239, 240, 255}, {236, 238, 255}, {234, 237, 255},
+    {231, 236, 255}, {229, 234, 255}, {227, 233, 255}, {226, 232, 255}, {224, 231, 255}, {222, 230, 255}, {221, 229, 255}, {219, 228, 255},
+    {218, 228, 255}, {217, 227, 255}, {215, 226, 255}, {214, 225, 255}, {213, 225, 255}, {212, 224, 255}, {211, 224, 255}, {210, 223, 255},
+    {209, 222, 255}, {208, 222, 255}, {207, 221, 255}, {206, 221, 255}, {206, 220, 255}, {205, 220, 255}, {204, 219, 255}, {203, 219, 255},
+    {203, 218, 255}, {202, 218, 255}, {201, 218, 255}, {201, 217, 255}, {200, 217, 255}, {199, 216, 255}, {199, 216, 255}, {198, 216, 255},
+    {197, 215, 255}, {197, 215, 255}, {196, 215, 255}, {196, 214, 255}, {195, 214, 255}, {195, 214, 255}, {194, 213, 255}, {194, 213, 255},
+    {193, 213, 255}, {193, 212, 255}, {192, 212, 255}, {192, 212, 255}, {191, 212, 255}, {191, 211, 255}, {191, 211, 255}, {190, 211, 255},
+    {190, 210, 255}, {189, 210, 255}, {189, 210, 255}, {189, 210, 255}, {188, 209, 255}, {188, 209, 255}, {187, 209, 255}, {187, 209, 255},
+    {187, 209, 255}, {186, 208, 255}, {186, 208, 255}, {186, 208, 255}, {185, 208, 255}, {185, 207, 255}, {185, 207, 255}, {184, 207, 255},
+    {184, 207, 255}, {184, 207, 255}, {183, 206, 255}, {183, 206, 255}, {183, 206, 255}, {183, 206, 255}, {182, 206, 255}, {182, 206, 255},
+    {182, 205, 255}, {181, 205, 255}, {181, 205, 255}, {181, 205, 255}, {181, 205, 255}, {180, 204, 255}, {180, 204, 255}, {180, 204, 255},
+    {180, 204, 255}, {179, 204, 255}, {179, 204, 255}, {179, 203, 255}, {179, 203, 255}, {178, 203, 255}, {178, 203, 255}, {178, 203, 255},
+    {178, 203, 255}, {177, 203, 255}, {177, 202, 255}, {177, 202, 255}, {177, 202, 255}, {176, 202, 255}, {176, 202, 255}, {176, 202, 255},
+    {176, 202, 255}, {176, 201, 255}, {175, 201, 255}, {175, 201, 255}, {175, 201, 255}, {175, 201, 255}, {175, 201, 255}, {174, 201, 255},
+    {174, 200, 255}, {174, 200, 255}, {174, 200, 255}, {174, 200, 255}, {173, 200, 255}, {173, 200, 255}, {173, 200, 255}, {173, 200, 255},
+    {173, 199, 255}, {172, 199, 255}, {172, 199, 255}, {172, 199, 255}, {172, 199, 255}, {172, 199, 255}, {172, 199, 255}, {171, 199, 255},
+    {171, 199, 255}, {171, 198, 255}, {171, 198, 255}, {171, 198, 255}, {171, 198, 255}, {170, 198, 255}, {170, 198, 255}, {170, 198, 255},
+    {170, 198, 255}, {170, 198, 255}, {170, 197, 255}, {169, 197, 255}, {169, 197, 255}, {169, 197, 255}, {169, 197, 255}, {169, 197, 255},
+    {169, 197, 255}, {168, 197, 255}, {168, 197, 255}, {168, 197, 255}, {168, 196, 255}, {168, 196, 255}, {168, 196, 255}, {168, 196, 255},
+    {167, 196, 255}, {167, 196, 255}, {167, 196, 255}, {167, 196, 255}, {167, 196, 255}, {167, 196, 255}, {167, 196, 255}, {167, 195, 255},
+    {166, 195, 255}, {166, 195, 255}, {166, 195, 255}, {166, 195, 255}, {166, 195, 255}, {166, 195, 255}, {166, 195, 255}, {165, 195, 255},
+    {165, 195, 255}, {165, 195, 255}, {165, 194, 255}, {165, 194, 255}, {165, 194, 255}, {165, 194, 255}, {165, 194, 255}, {164, 194, 255},
+    {164, 194, 255}, {164, 194, 255}, {164, 194, 255}, {164, 194, 255}, {164, 194, 255}, {164, 194, 255}, {164, 194, 255}, {164, 193, 255},
+    {163, 193, 255}, {163, 193, 255}, {163, 193, 255}, {163, 193, 255}, {163, 193, 255}, {163, 193, 255}, {163, 193, 255}, {163, 193, 255},
+    {163, 193, 255}, {162, 193, 255}, {162, 193, 255}, {162, 193, 255}, {162, 192, 255}, {162, 192, 255}, {162, 192, 255}, {162, 192, 255},
+    {162, 192, 255}, {162, 192, 255}, {161, 192, 255}, {161, 192, 255}, {161, 192, 255}, {161, 192, 255}, {161, 192, 255}, {161, 192, 255},
+    {161, 192, 255}, {161, 192, 255}, {161, 191, 255}, {161, 191, 255}, {160, 191, 255}, {160, 191, 255}, {160, 191, 255}, {160, 191, 255},
+    {160, 191, 255}, {160, 191, 255}, {160, 191, 255}, {160, 191, 255}, {160, 191, 255}, {160, 191, 255}, {159, 191, 255}, {159, 191, 255},
+    {159, 191, 255}, {159, 191, 255}, {159, 190, 255}, {159, 190, 255}, {159, 190, 255}, {159, 190, 255}, {159, 190, 255}, {159, 190, 255},
+    {159, 190, 255}, {158, 190, 255}, {158, 190, 255}, {158, 190, 255}, {158, 190, 255}, {158, 190, 255}, {158, 190, 255}, {158, 190, 255},
+    {158, 190, 255}, {158, 190, 255}, {158, 190, 255}, {158, 189, 255}, {158, 189, 255}, {157, 189, 255}, {157, 189, 255}, {157, 189, 255},
+    {157, 189, 255}, {157, 189, 255}, {157, 189, 255}, {157, 189, 255}, {157, 189, 255}, {157, 189, 255}, {157, 189, 255}, {157, 189, 255},
+    {157, 189, 255}, {156, 189, 255}, {156, 189, 255}, {156, 189, 255}, {156, 189, 255}, {156, 188, 255}, {156, 188, 255}, {156, 188, 255},
+    {156, 188, 255}, {156, 188, 255}, {156, 188, 255}, {156, 188, 255}, {156, 188, 255}, {156, 188, 255}, {155, 188, 255}, {155, 188, 255},
+    {155, 188, 255}, {155, 188, 255}, {155, 188, 255}, {155, 188, 255}, {155, 188, 255}, {155, 188, 255}, {155, 188, 255}, {155, 188, 255},
+    {155, 187, 255}, {155, 187, 255}, {155, 187, 255}, {154, 187, 255}, {154, 187, 255}, {154, 187, 255}, {154, 187, 255}, {154, 187, 255},
+    {154, 187, 255}, {154, 187, 255}, {154, 187, 255}, {154, 187, 255}, {154, 187, 255}, {154, 187, 255}, {154, 187, 255}, {154, 187, 255},
+    {154, 187, 255}, {154, 187, 255}, {153, 187, 255}, {153, 187, 255}, {153, 187, 255}, {153, 186, 255}, {153, 186, 255}, {153, 186, 255},
+    {153, 186, 255}, {153, 186, 255}, {153, 186, 255}, {153, 186, 255}, {153, 186, 255}, {153, 186, 255}, {153, 186, 255}, {153, 186, 255},
+    {153, 186, 255}, {152, 186, 255}, {152, 186, 255}, {152, 186, 255}, {152, 186, 255}, {152, 186, 255}, {152, 186, 255}, {152, 186, 255},
+    {152, 186, 255}, {152, 186, 255}, {152, 186, 255}, {152, 185, 255}, {152, 185, 255}, {152, 185, 255}, {152, 185, 255}, {152, 185, 255},
+    {152, 185, 255}, {151, 185, 255}, {151, 185, 255}, {151, 185, 255}, {151, 185, 255}, {151, 185, 255}, {151, 185, 255},
+};
+static_assert(ARRAY_LENGTH(KELVIN_TABLE) == (KELVIN_MAX - KELVIN_MIN) / KELVIN_STEP + 1,
+                "KELVIN_TABLE size mismatch!");
+
 uint32_t kelvin2rgb(uint32_t t) {
-    double temperature = (double) t / 100;
-    double red, green, blue;
-    // Red
-    if (temperature <= 66) {
-        red = 255;
-    } else {
-        red = temperature - 60;
-        red = 329.698727446 * pow(red, -0.1332047592);
-        red = constrain(red, 0, 255);
-    }
-    // Green
-    if (temperature <= 66) {
-        green = temperature;
-        green = 99.4708025861 * log(green) - 161.1195681661;
-        green = constrain(green, 0, 255);
-    } else {
-        green = temperature - 60;
-        green = 288.1221695283 * pow(green, -0.0755148492);
-        green = constrain(green, 0, 255);
-    }
-    // Blue
-    if (temperature >= 66) {
-        blue = 255;
-    } else if (temperature <= 19) {
-        blue = 0;
-    } else {
-        blue = temperature - 10;
-        blue = 138.5177312231 * log(blue) - 305.0447927307;
-        blue = constrain(blue, 0, 255);
+    t = constrain(t, KELVIN_MIN, KELVIN_MAX);
+    uint32_t index = (t - KELVIN_MIN) / KELVIN_STEP;
+    uint32_t frac = (t - KELVIN_MIN) % KELVIN_STEP;
+    uint8_t rgb[3];
+    for (int i = 0; i < 3; i++) {
+        int from = pgm_read_byte(&KELVIN_TABLE[index][i]);
+        int to = frac ? pgm_read_byte(&KELVIN_TABLE[index + 1][i]) : from;
+        rgb[i] = from + (to - from) * (int) frac / (int) KELVIN_STEP;
     }
-    return rgb2hex((uint8_t) red, (uint8_t) green, (uint8_t) blue);
+    return rgb2hex(rgb[0], rgb[1], rgb[2]);
 }
 
 EffectType str2effect(const char *str) {
@@ -51,6 +51,48 @@ constexpr T sum(T *begin, T *end, typename std::decay<T>::type init) {
     return begin == end ? init : sum(begin + 1, end, init + *begin);
 }
 
+// C++14 的 std::index_sequence, 按对半拼接生成, 模板递归深度只有 log(N)
+template <int... I>
+struct IndexSequence {};
+
+template <typename A, typename B>
+struct ConcatIndexSequence;
+
+template <int... I, int... J>
+struct ConcatIndexSequence<IndexSequence<I...>, IndexSequence<J...>> {
+    typedef IndexSequence<I..., (sizeof...(I) + J)...> type;
+};
+
+template <int N>
+struct MakeIndexSequence {
+    typedef typename ConcatIndexSequence<typename MakeIndexSequence<N / 2>::type,
+        typename MakeIndexSequence<N - N / 2>::type>::type type;
+};
+
+template <>
+struct MakeIndexSequence<0> {
+    typedef IndexSequence<> type;
+};
+
+template <>
+struct MakeIndexSequence<1> {
+    typedef IndexSequence<0> type;
+};
+
+/**
+ * 编译期生成并存放在 Flash 中的查找表, 第 i 项为 MAP::index(i), 需用 pgm_read_word 读取
+ */
+template <typename MAP, typename SEQUENCE = typename MakeIndexSequence<MAP::size>::type>
+struct IndexTable;
+
+template <typename MAP, int... I>
+struct IndexTable<MAP, IndexSequence<I...>> {
+    static const uint16_t data[sizeof...(I)];
+};
+
+template <typename MAP, int... I>
+const uint16_t IndexTable<MAP, IndexSequence<I...>>::data[sizeof...(I)] PROGMEM = {MAP::index(I)...};
+
 #if __cplusplus >= 201703L
 template <typename T>
 inline const char *C_STR(const T &str) {
@@ -0,0 +1,89 @@
+#include <unity.h>
+
+#include "ColorPipeline.hpp"
+
+// 与 config.h 中的 LED_MAX_POWER_MW 对应的电流限制 (mA)
+static const uint32_t LIMIT = LED_MAX_POWER_MW / LED_VOLTAGE;
+static const int MAX_COUNT = 1024;
+
+static CRGB in[MAX_COUNT];
+static CRGB out[MAX_COUNT];
+
+static void fill(int count, const CRGB &color) {
+    for (int i = 0; i < count; i++) {
+        in[i] = color;
+    }
+}
+
+static bool isBlack(int count) {
+    for (int i = 0; i < count; i++) {
+        if (out[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void test_unlimited() {
+    ColorPipeline pipeline;
+    fill(1, CRGB::White);
+    TEST_ASSERT_FALSE(pipeline.apply(in, out, 1));
+    TEST_ASSERT_EQUAL_UINT8(255, out[0].r);
+    TEST_ASSERT_EQUAL_UINT8(255, out[0].g);
+    TEST_ASSERT_EQUAL_UINT8(255, out[0].b);
+}
+
+void test_limit_in_one_frame() {
+    // 满亮度白光远超限制, 第一帧就压到限制以内
+    ColorPipeline pipeline;
+    int count = 100;
+    fill(count, CRGB::White);
+    pipeline.apply(in, out, count);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(LIMIT, pipeline.getCurrent());
+    TEST_ASSERT_FALSE(isBlack(count));
+    for (int i = 0; i < 100; i++) {
+        pipeline.apply(in, out, count);
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(LIMIT, pipeline.getCurrent());
+    }
+}
+
+void test_release() {
+    ColorPipeline pipeline;
+    int count = 100;
+    fill(count, CRGB::White);
+    pipeline.apply(in, out, count);
+    // 画面变暗后逐渐恢复到不限制
+    fill(count, CRGB(1, 1, 1));
+    for (int i = 0; i < 1000; i++) {
+        pipeline.apply(in, out, count);
+    }
+    TEST_ASSERT_EQUAL_UINT8(1, out[0].r);
+}
+
+void test_idle_over_limit() {
+    // 仅静态电流就达到限制, 如 LightCube<8, 8, 8> 的 512 颗灯珠, 保持最低亮度而不是全黑
+    int count = LIMIT / LED_IDLE_CURRENT_MA + 12;
+    TEST_ASSERT_LESS_OR_EQUAL_INT(MAX_COUNT, count);
+    ColorPipeline pipeline;
+    fill(count, CRGB::White);
+    for (int i = 0; i < 100; i++) {
+        pipeline.apply(in, out, count);
+        TEST_ASSERT_FALSE(isBlack(count));
+    }
+    TEST_ASSERT_EQUAL_UINT8((uint32_t) 255 * POWER_LIMIT_MIN / POWER_LIMIT_ONE, out[0].r);
+    // 全黑的画面也不会把比例压到 0
+    fill(count, CRGB::Black);
+    pipeline.apply(in, out, count);
+    fill(count, CRGB::White);
+    pipeline.apply(in, out, count);
+    TEST_ASSERT_FALSE(isBlack(count));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_unlimited);
+    RUN_TEST(test_limit_in_one_frame);
+    RUN_TEST(test_release);
+    RUN_TEST(test_idle_over_limit);
+    return UNITY_END();
+}
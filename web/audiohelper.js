@@ -9,21 +9,19 @@ let ctx;
 let analyser;
 let frequencies;
 let soundProcessor;
+let soundBands;
 let mediaStream;
 let audioSource;
 let timerId;
-
-let outBands = 1;
-if (LIGHT_TYPE.type == "LightPanel") {
-    outBands = parseInt(LIGHT_TYPE.args[0]); // width of panel
-}
+let timerCallback;
+let interval = 50;
 
 // cubic-bezier(0.65, 0, 0.35, 1)
 function easeInOutCubic(x) {
     return x < 0.5 ? 4 * x * x * x : 1 - Math.pow(-2 * x + 2, 3) / 2;
 }
 
-function startRecord(onData, onError) {
+function startRecord(bands, onData, onError) {
     if (!window.navigator.mediaDevices) {
         let url = "chrome://flags/#unsafely-treat-insecure-origin-as-secure";
         onError(`因浏览器策略限制无法启动音频采集, 请前往 ${url} (已自动复制到剪贴板), 将此页面的链接添加到列表中并重启浏览器`);
@@ -41,6 +39,9 @@ function startRecord(onData, onError) {
             analyser = ctx.createAnalyser();
             analyser.fftSize = 1024;
             frequencies = new Uint8Array(analyser.frequencyBinCount);
+        }
+        // 频段数由设备决定, 换了设备要重新创建
+        if (!soundProcessor || soundBands != bands) {
             soundProcessor = new SoundProcessor({
                 filterParams: {
                     sigma: 1,
@@ -50,21 +51,24 @@ function startRecord(onData, onError) {
                 fftSize: analyser.fftSize,
                 startFrequency: 150,
                 endFrequency: 6000,
-                outBandsQty: outBands,
+                outBandsQty: bands,
                 tWeight: true,
                 aWeight: true
             });
+            soundBands = bands;
         }
 
         mediaStream = stream;
         audioSource = ctx.createMediaStreamSource(stream);
         audioSource.connect(analyser);
-        timerId = setInterval(() => {
+        interval = 50;
+        timerCallback = () => {
             analyser.getByteFrequencyData(frequencies);
             let result = soundProcessor.process(frequencies);
             let scaledResult = result.map((value) => easeInOutCubic(value / 255));
             onData(scaledResult);
-        }, 50);
+        };
+        timerId = setInterval(timerCallback, interval);
     }).catch((err) => {
         onError("请共享整个屏幕并勾选同时共享系统音频以便使用音乐律动模式, 错误详情: " + err.message);
     });
@@ -83,7 +87,18 @@ function stopRecord() {
     mediaStream = audioSource = timerId = null;
 }
 
+// 设备来不及显示时会要求把发送间隔调大到至少 ms 毫秒
+function throttleRecord(ms) {
+    if (ms <= interval) return;
+    interval = ms;
+    if (timerId) {
+        clearInterval(timerId);
+        timerId = setInterval(timerCallback, interval);
+    }
+}
+
 export {
     startRecord,
-    stopRecord
+    stopRecord,
+    throttleRecord
 };
@@ -128,6 +128,161 @@ async function loadAnim(name) {
     } catch (_) {}
 }
 
+// 烘焙动画的帧率
+const ANIMATION_FPS = 30;
+
+// 按板端的 v2 压缩动画格式编码, 详见 AnimationFile.hpp: 20 字节文件头, 调色板, 帧数据, 帧偏移表
+function encodeAnim(frames, ledCount, fps) {
+    const HEADER_SIZE = 20;
+    const KEY_INTERVAL = fps; // 至少每秒一个关键帧, 往回跳时不需要从头解码
+    const pixels = frames.map(frame => {
+        const colors = [];
+        for (let i = 0; i < ledCount; i++) {
+            colors.push(frame[i * 3] << 16 | frame[i * 3 + 1] << 8 | frame[i * 3 + 2]);
+        }
+        return colors;
+    });
+    // 颜色不超过 256 种时使用调色板, 每个颜色只占 1 字节
+    const colors = [...new Set(pixels.flat())];
+    const palette = colors.length <= 256 ? new Map(colors.map((color, i) => [color, i])) : null;
+    const writeColor = (out, color) => {
+        if (palette) out.push(palette.get(color));
+        else out.push(color >> 16, (color >> 8) & 0xFF, color & 0xFF);
+    };
+    // 片段: 0x00 逐个颜色, 0x40 重复一个颜色, 0x80 保持上一帧, 低 6 位为灯珠数减 1
+    const encodeFrame = (cur, prev) => {
+        const out = [prev ? 1 : 0];
+        const same = j => prev && cur[j] == prev[j];
+        const repeat = j => j + 1 < ledCount && cur[j + 1] == cur[j];
+        for (let i = 0; i < ledCount;) {
+            let n = 1;
+            if (same(i)) {
+                while (i + n < ledCount && n < 64 && same(i + n)) n++;
+                out.push(0x80 | (n - 1));
+            } else if (repeat(i)) {
+                while (i + n < ledCount && n < 64 && cur[i + n] == cur[i]) n++;
+                out.push(0x40 | (n - 1));
+                writeColor(out, cur[i]);
+            } else {
+                while (i + n < ledCount && n < 64 && !same(i + n) && !repeat(i + n)) n++;
+                out.push(n - 1);
+                for (let j = i; j < i + n; j++) writeColor(out, cur[j]);
+            }
+            i += n;
+        }
+        return out;
+    };
+    let lastKey = 0;
+    const encoded = pixels.map((cur, i) => {
+        const key = encodeFrame(cur, null);
+        if (i == 0 || i - lastKey >= KEY_INTERVAL) {
+            lastKey = i;
+            return { key: true, data: key };
+        }
+        const delta = encodeFrame(cur, pixels[i - 1]);
+        if (key.length <= delta.length) {
+            lastKey = i;
+            return { key: true, data: key };
+        }
+        return { key: false, data: delta };
+    });
+
+    let paletteSize = palette ? colors.length : 0;
+    let dataOffset = HEADER_SIZE + paletteSize * 3;
+    let indexOffset = encoded.reduce((size, frame) => size + frame.data.length, dataOffset);
+    const compressed = indexOffset < HEADER_SIZE + frames.length * ledCount * 3;
+    if (!compressed) { // 压缩后反而更大时直接保存 RGB
+        encoded.forEach((frame, i) => {
+            frame.key = true;
+            frame.data = frames[i];
+        });
+        paletteSize = 0;
+        dataOffset = HEADER_SIZE;
+        indexOffset = HEADER_SIZE + frames.length * ledCount * 3;
+    }
+    const buffer = new ArrayBuffer(indexOffset + (frames.length + 1) * 4);
+    const view = new DataView(buffer);
+    const bytes = new Uint8Array(buffer);
+    bytes.set([0x52, 0x47, 0x42, 0x4C]); // "RGBL"
+    view.setUint8(4, 2);                 // 版本
+    view.setUint8(5, compressed ? 1 : 0); // 颜色格式
+    view.setUint16(6, ledCount, true);
+    view.setUint16(8, fps, true);
+    view.setUint16(10, paletteSize, true);
+    view.setUint32(12, frames.length, true);
+    view.setUint32(16, indexOffset, true);
+    for (let i = 0; i < paletteSize; i++) {
+        bytes.set([colors[i] >> 16, (colors[i] >> 8) & 0xFF, colors[i] & 0xFF], HEADER_SIZE + i * 3);
+    }
+    let offset = dataOffset;
+    encoded.forEach((frame, i) => {
+        view.setUint32(indexOffset + i * 4, offset + (frame.key ? 0x80000000 : 0), true);
+        bytes.set(frame.data, offset);
+        offset += frame.data.length;
+    });
+    view.setUint32(indexOffset + frames.length * 4, offset, true);
+    return buffer;
+}
+
+// 关键帧动画求值时的帧率, 文件大小与帧率无关
+const KEYFRAME_FPS = 60;
+// 板端读入内存的关键帧数据上限, 与 config.h 中的 ANIMATION_KEYFRAME_SIZE 一致
+const KEYFRAME_MAX_SIZE = 16384;
+
+// 把编辑器保存的关键帧按板端的关键帧格式编码, 详见 AnimationFile.hpp, 设备播放时逐帧求值
+function encodeKeyframes(state, ledCount, fps) {
+    const HEADER_SIZE = 20;
+    const KEYFRAME_SIZE = 16;
+    const sheet = state.sheetsById["Light Animation"];
+    const sequence = sheet.sequence;
+    const toByte = value => Math.min(Math.max(parseInt(value * 255), 0), 255);
+    const toFixed = value => Math.round(Math.min(Math.max(value, -7.99), 7.99) * 4096);
+    const tracks = [];
+    for (let i = 0; i < ledCount; i++) {
+        const objName = `LED ${i + 1}`;
+        const track = sequence.tracksByObject?.[objName];
+        const trackId = track?.trackIdByPropPath?.['["color"]'];
+        let keyframes = trackId ? track.trackData[trackId].keyframes : [];
+        if (keyframes.length == 0) { // 没有关键帧时使用静态的颜色
+            const color = sheet.staticOverrides?.byObject?.[objName]?.color;
+            keyframes = color ? [{ position: 0, connectedRight: false, value: color }] : [];
+        }
+        tracks.push([...keyframes].sort((a, b) => a.position - b.position));
+    }
+    const count = tracks.reduce((n, keyframes) => n + keyframes.length, 0);
+    const indexOffset = HEADER_SIZE + count * KEYFRAME_SIZE;
+    const buffer = new ArrayBuffer(indexOffset + (ledCount + 1) * 4);
+    const view = new DataView(buffer);
+    new Uint8Array(buffer).set([0x52, 0x47, 0x42, 0x4C]); // "RGBL"
+    view.setUint8(4, 2);                 // 版本
+    view.setUint8(5, 2);                 // 关键帧格式
+    view.setUint16(6, ledCount, true);
+    view.setUint16(8, fps, true);
+    view.setUint32(12, Math.round((sequence.length ?? 10) * 1000), true);
+    view.setUint32(16, indexOffset, true);
+    let index = 0;
+    let offset = HEADER_SIZE;
+    tracks.forEach((keyframes, i) => {
+        view.setUint32(indexOffset + i * 4, index, true);
+        for (const keyframe of keyframes) {
+            const { r, g, b } = keyframe.value;
+            const hold = !keyframe.connectedRight || keyframe.type == "hold";
+            view.setUint32(offset, Math.round(keyframe.position * 1000), true);
+            view.setUint8(offset + 4, toByte(r));
+            view.setUint8(offset + 5, toByte(g));
+            view.setUint8(offset + 6, toByte(b));
+            view.setUint8(offset + 7, hold ? 1 : 0);
+            (keyframe.handles ?? [0.5, 1, 0.5, 0]).forEach((handle, j) => {
+                view.setInt16(offset + 8 + j * 2, toFixed(handle), true);
+            });
+            offset += KEYFRAME_SIZE;
+            index++;
+        }
+    });
+    view.setUint32(indexOffset + ledCount * 4, index, true);
+    return buffer;
+}
+
 async function saveAnim(project, name) {
     $toast("loading", "保存动画中", -1);
 
@@ -140,23 +295,25 @@ async function saveAnim(project, name) {
         if (!response.ok) throw new Error();
         
         // 保存板端使用的逐帧动画
-        const data = [];
+        const frames = [];
         const sequence = project.sheet("Light Animation").sequence;
         const pos = sequence.position;
         sequence.position = 0;
         while (sequence.position < val(sequence.pointer.length)) {
+            const frame = [];
             for (const obj of objs) {
                 const { r, g, b, a } = val(obj.props.color);
-                data.push(parseInt(r * 255), parseInt(g * 255), parseInt(b * 255));
+                frame.push(parseInt(r * 255), parseInt(g * 255), parseInt(b * 255));
             }
-            sequence.position += 1 / 30;
+            frames.push(frame);
+            sequence.position += 1 / ANIMATION_FPS;
         }
         sequence.position = pos;
-        const buffer = new ArrayBuffer(data.length);
-        const view = new Uint8Array(buffer);
-        for (let i = 0; i < data.length; i++) {
-            view[i] = data[i];
-        }
+        // 关键帧格式通常更小且不限帧率, 关键帧很密或超出板端内存上限时才保存逐帧动画
+        const baked = encodeAnim(frames, objs.length, ANIMATION_FPS);
+        const keyframes = encodeKeyframes(state, objs.length, KEYFRAME_FPS);
+        const fits = keyframes.byteLength - 20 <= KEYFRAME_MAX_SIZE;
+        const buffer = fits && keyframes.byteLength <= baked.byteLength ? keyframes : baked;
         // console.debug(buffer);
         response = await uploadAnim(`.${name}.bin`, buffer);
         if (!response.ok) throw new Error();
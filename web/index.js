@@ -5,7 +5,7 @@ import "flexi-color-picker/themes.css";
 import "flexi-color-picker";
 import ReconnectingWebSocket from "reconnecting-websocket";
 import CConsole from "./cconsole.js";
-import { startRecord, stopRecord } from "./audiohelper.js";
+import { startRecord, stopRecord, throttleRecord } from "./audiohelper.js";
 import { rgb2hex, bytes2str } from "./utils.js";
 
 /**
@@ -172,7 +172,7 @@ document.getElementById("refreshRate").onchange = function() {
     cconsole.execute("fps," + this.value);
 }
 
-async function updateMode(newModeButton) {
+async function updateMode(newModeButton, startInput = true) {
     let oldModeButton = document.getElementById("mode").getElementsByClassName("weui-btn_disabled")[0];
     oldModeButton.removeAttribute("disabled");
     oldModeButton.classList.remove("weui-btn_disabled");
@@ -201,13 +201,22 @@ async function updateMode(newModeButton) {
             animName.appendChild(option);
         }
         animName.value = lastValue;
-    } else if (mode == "music") {
-        startRecord(function(result) {
-            cconsole.execute(result.map((value) => String(Number(value).toFixed(2))).join(","));
-        }, function(message) {
-            stopRecord();
-            $dialog("音乐律动初始化失败", message, null, updateMode.bind(null, oldModeButton));
-        });
+    } else if (mode == "music" && startInput) {
+        // 先查询设备的频段数, 之后每帧以二进制发送 0~255 的音量, 不经过控制台以免刷屏
+        let listener = (msg) => {
+            let bands = parseInt(msg.data);
+            if (isNaN(bands)) return; // 忽略切换模式的回复
+            ws.removeEventListener("message", listener);
+            startRecord(bands, function(result) {
+                if (ws.readyState != WebSocket.OPEN) return;
+                ws.send(Uint8Array.of(0x01, ...result.map((value) => Math.round(Math.min(Math.max(value, 0), 1) * 255))));
+            }, function(message) {
+                stopRecord();
+                $dialog("音乐律动初始化失败", message, null, updateMode.bind(null, oldModeButton));
+            });
+        };
+        ws.addEventListener("message", listener);
+        cconsole.execute("bands");
     }
 }
 
@@ -575,21 +584,27 @@ const setQrcode = (data) => document.getElementById("qrcode").src = QRCode.gener
     margin: 2.5
 });
 
-async function refreshConfig() {
-    const response = await fetch("/config");
-    if (!response.ok) return;
-    let config = await response.json();
-    document.title = config["name"];
-    setQrcode("http://" + config["ip"] + "/");
-    document.getElementById("ssid").innerHTML = config["ssid"] || "未连接";
-    document.getElementById("name").innerText = config["name"];
-    document.getElementById("hostname").innerText = config["hostname"];
-
-    document.getElementById("brightness").value = config["brightness"];
-    document.getElementById("temperature").value = config["temperature"];
-    document.getElementById("refreshRate").value = config["refreshRate"];
+// 设备推送的状态变化只包含改变的字段, remote 为 true 时不打断正在拖动的滑条, 也不在本页开始采集音频
+function applyConfig(config, remote = false) {
+    if ("name" in config) {
+        document.title = config["name"];
+        document.getElementById("name").innerText = config["name"];
+    }
+    if ("hostname" in config) {
+        document.getElementById("hostname").innerText = config["hostname"];
+    }
+    for (let key of ["brightness", "temperature", "refreshRate"]) {
+        let element = document.getElementById(key);
+        if (key in config && !(remote && document.activeElement == element)) {
+            element.value = config[key];
+        }
+    }
+    if (!("mode" in config)) {
+        return Promise.resolve();
+    }
 
-    let promise = updateMode(document.getElementById(LIGHT_MODES[config["mode"]]));
+    let modeButton = document.getElementById(LIGHT_MODES[config["mode"]]);
+    let promise = remote && modeButton.hasAttribute("disabled") ? Promise.resolve() : updateMode(modeButton, !remote);
     let color = config["color"] || 0xFFFFFF;
     let rgb = {
         r: (color & 0xFF0000) >> 16,
@@ -605,8 +620,18 @@ async function refreshConfig() {
     document.getElementById("lastTime").value = config["lastTime"] || 1.0;
     document.getElementById("interval").value = config["interval"] || 1.0;
     document.getElementById("delta").value = config["delta"] || 1;
-    await promise; // Wait for loading anim list
-    document.getElementById("animName").value = config["animName"] || "";
+    return promise.then(() => { // Wait for loading anim list
+        document.getElementById("animName").value = config["animName"] || "";
+    });
+}
+
+async function refreshConfig() {
+    const response = await fetch("/config");
+    if (!response.ok) return;
+    let config = await response.json();
+    setQrcode("http://" + config["ip"] + "/");
+    document.getElementById("ssid").innerHTML = config["ssid"] || "未连接";
+    await applyConfig(config);
 }
 
 window.onload = function() {
@@ -620,6 +645,11 @@ window.onload = function() {
         $info("error", "无法连接至小彩灯, 请检查设备状态!", true);
     });
     ws.addEventListener("message", (msg) => {
+        if (typeof msg.data == "string" && msg.data.startsWith("THROTTLE,")) {
+            throttleRecord(parseInt(msg.data.split(",")[1]));
+        } else if (typeof msg.data == "string" && msg.data.startsWith("STATE,")) {
+            applyConfig(JSON.parse(msg.data.substring(6)), true);
+        }
         cconsole.print("接收: " + msg.data);
     });
     ws.reconnect();